@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""
+Checks the 64-bit offset paths end to end with the headless search mode.
+
+Creates a sparse file just over 4GB with a needle before, across and after the 4GB mark,
+then runs "0xed file --count" and "0xed file --export" (csv and binary) and compares the
+counts and the exported offsets with the positions the needle was written at.
+
+usage: check_large_file.py path/to/0xed[.exe] [work_dir]
+"""
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+
+FILE_SIZE = (4 << 30) + (64 << 20) # past 4GB, also past the default pagedFileMinSizeMb (block cache path)
+NEEDLE = b"0xedNEEDLE4GB!"
+OFFSETS = [
+    0,
+    0x1000,
+    0x7FFFFFF9,              # across the 2GB mark (i32 overflow)
+    0xFFFFFFF8,              # across the 4GB mark (u32 overflow)
+    0x100000010,             # just after 4GB (a needle starting at 4GB would overlap the previous one)
+    0x100000000 + 0x1234567, # after 4GB
+    FILE_SIZE - len(NEEDLE), # last bytes of the file
+]
+
+def makeSparse(f):
+    if os.name != "nt":
+        return # seeking past the end leaves holes
+    # NTFS zero fills the gaps unless the file is flagged sparse
+    import ctypes
+    import msvcrt
+    FSCTL_SET_SPARSE = 0x900C4
+    returned = ctypes.c_ulong(0)
+    handle = msvcrt.get_osfhandle(f.fileno())
+    if not ctypes.windll.kernel32.DeviceIoControl(handle, FSCTL_SET_SPARSE, None, 0, None, 0,
+                                                  ctypes.byref(returned), None):
+        print("warning: could not make the file sparse, it will use %d MB of disk" % (FILE_SIZE >> 20))
+
+def writeTestFile(path):
+    with open(path, "wb") as f:
+        makeSparse(f)
+        f.truncate(FILE_SIZE)
+        for offset in OFFSETS:
+            f.seek(offset)
+            f.write(NEEDLE)
+
+def run(exe, args):
+    proc = subprocess.run([exe] + args, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    if proc.returncode != 0:
+        print("FAILED: %s exited with %d\n%s" % (" ".join(args), proc.returncode, proc.stderr.decode(errors="replace")))
+        return None
+    return int(proc.stdout.decode().strip())
+
+def readCsv(path):
+    with open(path) as f:
+        lines = f.read().splitlines()
+    assert lines[0] == "offset,length,pattern", lines[0]
+    return [(int(offset), int(length)) for offset, length, _ in (l.split(",") for l in lines[1:])]
+
+def readBinary(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    return [(offset, length) for offset, length, _ in struct.iter_unpack("<qii", data)]
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__.strip())
+        return 2
+
+    exe = os.path.abspath(sys.argv[1])
+    workDir = sys.argv[2] if len(sys.argv) > 2 else tempfile.gettempdir()
+    dataPath = os.path.join(workDir, "0xed_4gb.bin")
+    csvPath = os.path.join(workDir, "0xed_4gb.csv")
+    binPath = os.path.join(workDir, "0xed_4gb_results.bin")
+
+    expected = [(offset, len(NEEDLE)) for offset in sorted(OFFSETS)]
+    hexNeedle = " ".join("%02X" % b for b in NEEDLE)
+    fails = 0
+
+    writeTestFile(dataPath)
+    try:
+        checks = [
+            ("count", ["--count", NEEDLE.decode()], None),
+            ("count hex", ["--count", "--hex", hexNeedle], None),
+            ("export csv", ["--export", NEEDLE.decode(), csvPath], lambda: readCsv(csvPath)),
+            ("export binary", ["--export", "--hex", hexNeedle, binPath], lambda: readBinary(binPath)),
+        ]
+        for name, args, readExport in checks:
+            count = run(exe, [dataPath] + args)
+            ok = count == len(expected)
+            if ok and readExport:
+                found = readExport()
+                ok = found == expected
+                if not ok:
+                    print("  exported %s\n  expected %s" % (found, expected))
+            print("%s %s (count %s, expected %d)" % ("ok  " if ok else "FAIL", name, count, len(expected)))
+            fails += not ok
+    finally:
+        for path in (dataPath, csvPath, binPath):
+            if os.path.exists(path):
+                os.remove(path)
+
+    print("done, %d failed" % fails)
+    return 1 if fails else 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,4 +1,5 @@
 #include "bricks.h"
+#include "file_source.h"
 
 #ifdef OXED_PROFILE
     #include <easy/profiler.h>
@@ -189,6 +190,49 @@ const Brick* BrickWall::getBrick(intptr_t offset)
     return nullptr;
 }
 
+static void findFieldInBrick(const BrickWall& wall, i64 start, i64 size, BrickType type, i32 structId,
+                             i64 fieldOffset, i32 depth, Array<i64>* starts)
+{
+    if(type < BrickType_USER_STRUCT || depth > 16) return;
+    const i32 id = type - BrickType_USER_STRUCT;
+    const BrickStruct& bstruct = wall.structs[id];
+    if(bstruct._size <= 0) return;
+
+    for(i64 elt = start; elt + bstruct._size <= start + size; elt += bstruct._size) {
+        if(id == structId) {
+            starts->push(elt + fieldOffset);
+            continue;
+        }
+
+        i64 cur = elt;
+        const i32 count = bstruct.bricks.count();
+        for(i32 i = 0; i < count; ++i) {
+            const Brick& b = bstruct.bricks[i];
+            findFieldInBrick(wall, cur, b.size, b.type, structId, fieldOffset, depth + 1, starts);
+            cur += b.size;
+        }
+    }
+}
+
+void BrickWall::findFieldInstances(i32 structId, i32 fieldId, Array<i64>* starts) const
+{
+    if(structId < 0 || structId >= structs.count()) return;
+    const BrickStruct& bstruct = structs[structId];
+    if(fieldId < 0 || fieldId >= bstruct.bricks.count()) return;
+
+    // fields follow each other
+    i64 fieldOffset = 0;
+    for(i32 i = 0; i < fieldId; ++i) {
+        fieldOffset += bstruct.bricks[i].size;
+    }
+
+    const i32 count = bricks.count();
+    for(i32 i = 0; i < count; ++i) {
+        const Brick& b = bricks[i];
+        findFieldInBrick(*this, b.start, b.size, b.type, structId, fieldOffset, 0, starts);
+    }
+}
+
 BrickStruct* BrickWall::newStructDef(const char* name, u32 color)
 {
     BrickStruct brickStruct;
@@ -563,7 +607,7 @@ void ui_brickStructList(BrickWall* brickWall)
     }
 }
 
-static bool doBrickNode(Brick brick, const Array<BrickWall::TypeInfo>& typeCache, const u8* fileData,
+static bool doBrickNode(Brick brick, const Array<BrickWall::TypeInfo>& typeCache, const FileSource& fileSource,
                          i32 identLvl, i32 arrayIndex = -1)
 {
     EASY_FUNCTION();
@@ -630,7 +674,7 @@ static bool doBrickNode(Brick brick, const Array<BrickWall::TypeInfo>& typeCache
                     Brick arrBrick = brick;
                     arrBrick.start += a * typeSize;
                     arrBrick.size = typeSize;
-                    doBrickNode(arrBrick, typeCache, fileData, identLvl + 1, a);
+                    doBrickNode(arrBrick, typeCache, fileSource, identLvl + 1, a);
                 }
             }
         }
@@ -647,7 +691,7 @@ static bool doBrickNode(Brick brick, const Array<BrickWall::TypeInfo>& typeCache
                 Brick arrBrick = subBricks[j];
                 arrBrick.start = brick.start + offset;
                 offset += arrBrick.size;
-                doBrickNode(arrBrick, typeCache, fileData, identLvl + 1);
+                doBrickNode(arrBrick, typeCache, fileSource, identLvl + 1);
             }
         }
     }
@@ -678,7 +722,9 @@ static bool doBrickNode(Brick brick, const Array<BrickWall::TypeInfo>& typeCache
         ImGui::RenderTextClipped(frameBb.Min + off, frameBb.Max, branchName,
                                  NULL, NULL, ImVec2(0.0, 0.5), &frameBb);
 
-        const u8* data = fileData + brick.start;
+        u64 leafData = 0;
+        fileSource.read(brick.start, &leafData, MIN(brick.size, (i64)sizeof(leafData)));
+        const u8* data = (const u8*)&leafData;
         const i64 dataSize = brick.size;
         char dataBuff[64];
         i32 dataBuffLen = 0;
@@ -758,7 +804,7 @@ static bool doBrickNode(Brick brick, const Array<BrickWall::TypeInfo>& typeCache
     return false;
 }
 
-void uiBrickWallWindow(BrickWall* brickWall, const u8* fileData)
+void uiBrickWallWindow(BrickWall* brickWall, const FileSource& fileSource)
 {
     EASY_FUNCTION(profiler::colors::Yellow);
 
@@ -778,7 +824,7 @@ void uiBrickWallWindow(BrickWall* brickWall, const u8* fileData)
     for(i32 i = 0; i < brickCount; ++i) {
         const Brick& b = bricks[i];
         EASY_BLOCK("doBrickNode")
-        doBrickNode(b, brickWall->typeCache, fileData, 0);
+        doBrickNode(b, brickWall->typeCache, fileSource, 0);
         EASY_END_BLOCK;
     }
 
@@ -92,10 +92,12 @@ struct BrickWall
     bool insertBrickStruct(const char* name, i32 nameLen, intptr_t where, i32 arrayCount,
                            const BrickStruct& bstruct);
     const Brick* getBrick(intptr_t offset);
+    // Start offset of every instance of structs[structId].bricks[fieldId], nested structs included
+    void findFieldInstances(i32 structId, i32 fieldId, Array<i64>* starts) const;
 
     BrickStruct* newStructDef(const char* name, u32 color);
 };
 
 void ui_brickPopup(const char* popupId, intptr_t selStart, i64 selLength, BrickWall* wall);
 void ui_brickStructList(BrickWall* brickWall);
-void uiBrickWallWindow(BrickWall* brickWall, const u8* fileData);
+void uiBrickWallWindow(BrickWall* brickWall, const struct FileSource& fileSource);
@@ -61,6 +61,13 @@ bool loadConfigFile(const char* path, Config* config)
     parseLine(cursor, 1, "maximized=%d", &config->windowMaximized);
     parseLine(cursor, 1, "panelCount=%d", &config->panelCount);
 
+    // optional section, older config files don't have it
+    if(strncmp(cursor, "[File]", 6) == 0) {
+        nextLine(&cursor);
+        parseLine(cursor, 1, "pagedFileMinSizeMb=%d", &config->pagedFileMinSizeMb);
+        parseLine(cursor, 1, "cacheBudgetMb=%d", &config->cacheBudgetMb);
+    }
+
 #undef parseLine
 
     config->windowMonitor = clamp(config->windowMonitor, 0, 1);
@@ -68,6 +75,8 @@ bool loadConfigFile(const char* path, Config* config)
     config->panelCount = clamp(config->panelCount, 1, 10);
 	config->windowWidth = MAX(100, config->windowWidth);
 	config->windowHeight = MAX(100, config->windowHeight);
+	config->pagedFileMinSizeMb = MAX(1, config->pagedFileMinSizeMb);
+	config->cacheBudgetMb = MAX(1, config->cacheBudgetMb);
 
     return true;
 }
@@ -86,6 +95,9 @@ bool saveConfigFile(const char* path, const Config& config)
     appendf(cursor, "height=%d\n", config.windowHeight);
     appendf(cursor, "maximized=%d\n", config.windowMaximized);
     appendf(cursor, "panelCount=%d\n", config.panelCount);
+    appendf(cursor, "[File]\n");
+    appendf(cursor, "pagedFileMinSizeMb=%d\n", config.pagedFileMinSizeMb);
+    appendf(cursor, "cacheBudgetMb=%d\n", config.cacheBudgetMb);
 
     appendf(cursor, "\n", config.windowHeight);
 
@@ -16,6 +16,8 @@ struct Config
     i32 windowHeight = WINDOW_HEIGHT;
     i32 windowMaximized = 0;
     i32 panelCount = 2;
+    i32 pagedFileMinSizeMb = 2048; // bigger files are read through the block cache
+    i32 cacheBudgetMb = 256;
 };
 
 bool loadConfigFile(const char* path, Config* config);
@@ -0,0 +1,547 @@
+#include "file_source.h"
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+void BlockCache::init(i64 budget, i64 blockSize_)
+{
+    release();
+    blockSize = blockSize_;
+    slotCapacity = MAX(2, budget / blockSize);
+    slots.reserve(slotCapacity);
+    slotOfBlock.reserve(slotCapacity);
+}
+
+void BlockCache::release()
+{
+    const i32 slotCount = slots.count();
+    for(i32 i = 0; i < slotCount; ++i) {
+        free(slots[i].data);
+    }
+    slots.clear();
+    slotOfBlock.clear();
+    lruHead = -1;
+    lruTail = -1;
+    hitCount = 0;
+    missCount = 0;
+}
+
+BlockCache::Slot* BlockCache::find(i64 blockId)
+{
+    auto found = slotOfBlock.find(blockId);
+    if(found == slotOfBlock.end()) {
+        missCount++;
+        return nullptr;
+    }
+
+    hitCount++;
+    const i32 slotId = found->second;
+    if(lruHead != slotId) {
+        _lruUnlink(slotId);
+        _lruPushFront(slotId);
+    }
+    return &slots[slotId];
+}
+
+BlockCache::Slot* BlockCache::insert(i64 blockId)
+{
+    assert(slotOfBlock.find(blockId) == slotOfBlock.end());
+
+    i32 slotId;
+    if(slots.count() < slotCapacity) {
+        slotId = slots.count();
+        Slot slot;
+        slot.data = (u8*)malloc(blockSize);
+        assert_msg(slot.data, "Failed to allocate");
+        slots.push(slot);
+    }
+    else {
+        // evict least recently used
+        slotId = lruTail;
+        assert(slotId >= 0);
+        _lruUnlink(slotId);
+        slotOfBlock.erase(slots[slotId].blockId);
+    }
+
+    Slot& slot = slots[slotId];
+    slot.blockId = blockId;
+    slot.len = 0;
+    slotOfBlock[blockId] = slotId;
+    _lruPushFront(slotId);
+    return &slot;
+}
+
+void BlockCache::_lruUnlink(i32 slotId)
+{
+    Slot& slot = slots[slotId];
+    if(slot.prev >= 0) slots[slot.prev].next = slot.next;
+    else lruHead = slot.next;
+    if(slot.next >= 0) slots[slot.next].prev = slot.prev;
+    else lruTail = slot.prev;
+    slot.prev = -1;
+    slot.next = -1;
+}
+
+void BlockCache::_lruPushFront(i32 slotId)
+{
+    Slot& slot = slots[slotId];
+    slot.prev = -1;
+    slot.next = lruHead;
+    if(lruHead >= 0) slots[lruHead].prev = slotId;
+    lruHead = slotId;
+    if(lruTail < 0) lruTail = slotId;
+}
+
+static i64 fileQuerySize(const char* path)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+    if(!GetFileAttributesExA(path, GetFileExInfoStandard, &attr)) {
+        return -1;
+    }
+    return ((i64)attr.nFileSizeHigh << 32) | attr.nFileSizeLow;
+#else
+    struct stat st;
+    if(stat(path, &st) != 0) {
+        return -1;
+    }
+    return st.st_size;
+#endif
+}
+
+bool FileSource::open(const char* path, i64 pagedMinSize, i64 cacheBudget)
+{
+    close();
+
+    if(fileQuerySize(path) >= pagedMinSize) {
+        return openPaged(path, cacheBudget);
+    }
+
+    if(openMapped(path, FileMapMode::PREFETCH)) {
+        return true;
+    }
+
+    // empty files and special files can't be mapped, read them whole instead
+    LOG("FileSource> could not map '%s', falling back to reading it in memory", path);
+    return openMemory(path);
+}
+
+bool FileSource::_openHandle(const char* path)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE) {
+        LOG("ERROR: Can not open file %s", path);
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(file, &fileSize)) {
+        CloseHandle(file);
+        return false;
+    }
+
+    hFile = file;
+    size = fileSize.QuadPart;
+#else
+    const i32 file = ::open(path, O_RDONLY);
+    if(file < 0) {
+        LOG("ERROR: Can not open file %s", path);
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(file, &st) != 0) {
+        ::close(file);
+        return false;
+    }
+
+    fd = file;
+    size = st.st_size;
+#endif
+    return true;
+}
+
+void FileSource::_closeHandle()
+{
+#ifdef _WIN32
+    if(hFile) {
+        CloseHandle((HANDLE)hFile);
+        hFile = nullptr;
+    }
+#else
+    if(fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+#endif
+}
+
+// Loads MEMORY sources in the background.
+// The start of the file (first screen) comes first in a small chunk so the hex view is usable right away.
+static i32 thread_fileLoad(void* ptr)
+{
+    FileSource& fs = *(FileSource*)ptr;
+    i64 chunkSize = FILE_LOAD_FIRST_CHUNK_SIZE;
+    i64 loaded = 0;
+
+    while(loaded < fs.size && !fs.loadCancel.load(std::memory_order_relaxed)) {
+        const i64 len = MIN(chunkSize, fs.size - loaded);
+        const i64 readCount = fs._readRaw(loaded, fs.memBuff.data + loaded, len);
+        if(readCount != len) {
+            LOG("ERROR: FileSource> read failed at offset %lld", loaded + readCount);
+            break;
+        }
+
+        loaded += len;
+        fs.loadedSize.store(loaded, std::memory_order_release);
+        chunkSize = FILE_LOAD_CHUNK_SIZE;
+    }
+
+    fs.loading.store(false, std::memory_order_release);
+    LOG("FileSource> loaded %lld/%lld bytes", loaded, fs.size);
+    return 0;
+}
+
+#ifdef _WIN32
+// PrefetchVirtualMemory is Windows 8+, looked up at runtime so the app still starts on 7
+struct FilePrefetchRange
+{
+    void* address;
+    size_t size;
+};
+typedef BOOL (WINAPI *PrefetchVirtualMemoryFunc)(HANDLE, ULONG_PTR, FilePrefetchRange*, ULONG);
+#endif
+
+// Asks the OS to read [start, start+size) of a mapping in ahead of the first access, without waiting for it
+static void filePrefetchPages(const u8* start, i64 size)
+{
+#ifdef _WIN32
+    static PrefetchVirtualMemoryFunc prefetchVirtualMemory =
+        (PrefetchVirtualMemoryFunc)GetProcAddress(GetModuleHandleA("kernel32.dll"), "PrefetchVirtualMemory");
+    if(prefetchVirtualMemory) {
+        FilePrefetchRange range = { (void*)start, (size_t)size };
+        prefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+#else
+    madvise((void*)start, size, MADV_WILLNEED);
+#endif
+}
+
+// Prefetches the window around the last range the view asked for, PREFETCH mappings only.
+// Only the latest request matters, the ones that came in while prefetching are dropped.
+static i32 thread_filePrefetch(void* ptr)
+{
+    FileSource& fs = *(FileSource*)ptr;
+
+    SDL_LockMutex(fs.prefetchMutex);
+    while(!fs.loadCancel.load(std::memory_order_relaxed)) {
+        if(!fs.prefetchPending) {
+            SDL_CondWait(fs.prefetchCond, fs.prefetchMutex);
+            continue;
+        }
+
+        const i64 start = fs.prefetchStart;
+        const i64 end = fs.prefetchEnd;
+        fs.prefetchPending = false;
+
+        SDL_UnlockMutex(fs.prefetchMutex);
+        filePrefetchPages(fs.data + start, end - start);
+        SDL_LockMutex(fs.prefetchMutex);
+    }
+    SDL_UnlockMutex(fs.prefetchMutex);
+    return 0;
+}
+
+void FileSource::_startLoading()
+{
+    loadedSize.store(0);
+    loadCancel.store(false);
+    loading.store(size > 0);
+    if(size > 0) {
+        loadThread = SDL_CreateThread(thread_fileLoad, "FileLoad", this);
+    }
+}
+
+void FileSource::_startPrefetching()
+{
+    prefetchMutex = SDL_CreateMutex();
+    prefetchCond = SDL_CreateCond();
+    prefetchStart = 0;
+    prefetchEnd = 0;
+    prefetchPending = false;
+    loadCancel.store(false);
+    loadThread = SDL_CreateThread(thread_filePrefetch, "FilePrefetch", this);
+}
+
+void FileSource::_stopLoading()
+{
+    if(loadThread) {
+        loadCancel.store(true);
+        if(prefetchMutex) {
+            // wake the prefetch thread up so it sees the cancel
+            SDL_LockMutex(prefetchMutex);
+            SDL_CondSignal(prefetchCond);
+            SDL_UnlockMutex(prefetchMutex);
+        }
+        i32 status;
+        SDL_WaitThread(loadThread, &status);
+        loadThread = nullptr;
+    }
+    loading.store(false);
+
+    if(prefetchMutex) {
+        SDL_DestroyCond(prefetchCond);
+        SDL_DestroyMutex(prefetchMutex);
+        prefetchCond = nullptr;
+        prefetchMutex = nullptr;
+    }
+}
+
+bool FileSource::openMapped(const char* path, FileMapMode::Enum mode)
+{
+    assert(kind == FileSourceKind::NONE);
+
+    if(!_openHandle(path)) {
+        return false;
+    }
+    if(size <= 0) {
+        _closeHandle();
+        return false;
+    }
+
+#ifdef _WIN32
+    HANDLE mapping = CreateFileMappingA((HANDLE)hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!mapping) {
+        _closeHandle();
+        return false;
+    }
+
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(!view) {
+        CloseHandle(mapping);
+        _closeHandle();
+        return false;
+    }
+
+    hMapping = mapping;
+#else
+    void* view = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if(view == MAP_FAILED) {
+        _closeHandle();
+        return false;
+    }
+#endif
+
+    data = (const u8*)view;
+    kind = FileSourceKind::MAPPED;
+    LOG("file mapped path=%s size=%lld", path, size);
+
+    // the OS pages the mapping in on demand, nothing to load
+    loadedSize.store(size);
+    if(mode == FileMapMode::PREFETCH) {
+        _startPrefetching();
+    }
+    return true;
+}
+
+bool FileSource::openPaged(const char* path, i64 cacheBudget)
+{
+    assert(kind == FileSourceKind::NONE);
+
+    if(!_openHandle(path)) {
+        return false;
+    }
+
+    cache.init(cacheBudget, FILE_CACHE_BLOCK_SIZE);
+    cacheMutex = SDL_CreateMutex();
+    kind = FileSourceKind::PAGED;
+    LOG("file opened paged path=%s size=%lld cache=%lldMB", path, size, cacheBudget / (1024*1024));
+
+    // nothing to load, blocks are read on demand
+    loadedSize.store(size);
+    return true;
+}
+
+bool FileSource::openMemory(const char* path)
+{
+    assert(kind == FileSourceKind::NONE);
+
+    if(!_openHandle(path)) {
+        return false;
+    }
+
+    memBuff.release();
+    memBuff.init(size + 1);
+    memBuff.size = size;
+    memBuff.data[size] = 0;
+
+    kind = FileSourceKind::MEMORY;
+    data = memBuff.data;
+    LOG("file loading path=%s size=%lld", path, size);
+
+    _startLoading();
+    return true;
+}
+
+void FileSource::close()
+{
+    _stopLoading();
+
+    switch(kind) {
+        case FileSourceKind::NONE: break;
+
+        case FileSourceKind::MEMORY: {
+            memBuff.release();
+        } break;
+
+        case FileSourceKind::MAPPED: {
+#ifdef _WIN32
+            UnmapViewOfFile(data);
+            CloseHandle((HANDLE)hMapping);
+            hMapping = nullptr;
+#else
+            munmap((void*)data, size);
+#endif
+        } break;
+
+        case FileSourceKind::PAGED: {
+            LOG("FileSource> cache hits=%lld misses=%lld", cache.hitCount, cache.missCount);
+            cache.release();
+            SDL_DestroyMutex(cacheMutex);
+            cacheMutex = nullptr;
+        } break;
+
+        default: assert(0); break;
+    }
+
+    _closeHandle();
+    kind = FileSourceKind::NONE;
+    data = nullptr;
+    size = 0;
+    loadedSize.store(0);
+}
+
+i64 FileSource::read(i64 offset, void* dst, i64 size_, FileReadHint::Enum hint) const
+{
+    const i64 avail = available();
+    if(offset < 0 || offset >= avail) {
+        return 0;
+    }
+    size_ = MIN(size_, avail - offset);
+
+    if(isContiguous()) {
+        memmove(dst, data + offset, size_);
+        return size_;
+    }
+
+    assert(kind == FileSourceKind::PAGED);
+
+    // a one pass scan would flush the whole cache for nothing
+    if(hint == FileReadHint::STREAM) {
+        return _readRaw(offset, dst, size_);
+    }
+
+    BlockCache& bc = cache;
+    const i64 blockSize = bc.blockSize;
+    u8* out = (u8*)dst;
+    i64 copied = 0;
+
+    SDL_LockMutex(cacheMutex);
+
+    while(copied < size_) {
+        const i64 cur = offset + copied;
+        const i64 blockId = cur / blockSize;
+        const i64 inBlock = cur - blockId * blockSize;
+
+        BlockCache::Slot* slot = bc.find(blockId);
+        if(!slot) {
+            slot = bc.insert(blockId);
+            slot->len = _readRaw(blockId * blockSize, slot->data, blockSize);
+        }
+
+        const i64 len = MIN(size_ - copied, slot->len - inBlock);
+        if(len <= 0) {
+            break; // file shrunk under us
+        }
+        memmove(out + copied, slot->data + inBlock, len);
+        copied += len;
+    }
+
+    SDL_UnlockMutex(cacheMutex);
+    return copied;
+}
+
+const u8* FileSource::fetch(i64 offset, i64 size_, u8* scratch, FileReadHint::Enum hint) const
+{
+    assert(offset >= 0 && size_ >= 0 && offset + size_ <= available());
+    if(isContiguous()) {
+        // a MEMORY source may not have loaded the range yet
+        return offset >= 0 && offset + size_ <= available() ? data + offset : nullptr;
+    }
+
+    if(read(offset, scratch, size_, hint) != size_) {
+        return nullptr; // short read, the scratch bytes past it are stale
+    }
+    return scratch;
+}
+
+void FileSource::prefetch(i64 offset, i64 size_) const
+{
+    if(!prefetchMutex) {
+        return;
+    }
+
+    offset = clamp(offset, (i64)0, size);
+    const i64 end = clamp(offset + size_, (i64)0, size);
+
+    SDL_LockMutex(prefetchMutex);
+    // still inside the last window, already prefetched (or being prefetched)
+    if(offset < prefetchStart || end > prefetchEnd) {
+        prefetchStart = MAX(offset - FILE_PREFETCH_AROUND, (i64)0) & ~(i64)4095; // page aligned
+        prefetchEnd = MIN(end + FILE_PREFETCH_AROUND, size);
+        prefetchPending = true;
+        SDL_CondSignal(prefetchCond);
+    }
+    SDL_UnlockMutex(prefetchMutex);
+}
+
+i64 FileSource::_readRaw(i64 offset, void* dst, i64 size_) const
+{
+    u8* out = (u8*)dst;
+    i64 done = 0;
+
+#ifdef _WIN32
+    while(done < size_) {
+        OVERLAPPED ov = {};
+        const i64 cur = offset + done;
+        ov.Offset = (DWORD)(cur & 0xFFFFFFFF);
+        ov.OffsetHigh = (DWORD)(cur >> 32);
+        const DWORD toRead = (DWORD)MIN(size_ - done, 1 << 30);
+        DWORD readCount = 0;
+        if(!ReadFile((HANDLE)hFile, out + done, toRead, &readCount, &ov) || readCount == 0) {
+            break;
+        }
+        done += readCount;
+    }
+#else
+    while(done < size_) {
+        const ssize_t readCount = pread(fd, out + done, size_ - done, offset + done);
+        if(readCount <= 0) {
+            break;
+        }
+        done += readCount;
+    }
+#endif
+
+    return done;
+}
@@ -0,0 +1,173 @@
+#pragma once
+#include "base.h"
+#include "utils.h"
+#include <unordered_map>
+#include <atomic>
+
+#define FILE_CACHE_BLOCK_SIZE (64 * 1024)
+#define FILE_LOAD_FIRST_CHUNK_SIZE (64 * 1024)
+#define FILE_LOAD_CHUNK_SIZE (4 * 1024 * 1024)
+#define FILE_PREFETCH_AROUND (8 * 1024 * 1024)
+
+struct FileSourceKind
+{
+    enum Enum: i32 {
+        NONE = 0,
+        MEMORY, // whole file read into a buffer
+        MAPPED, // read-only memory mapped view, paged in on demand by the OS
+        PAGED,  // read through a fixed budget block cache, for files larger than RAM
+    };
+};
+
+struct FileMapMode
+{
+    enum Enum: i32 {
+        LAZY = 0, // paged in by the OS when touched, nothing runs in the background
+        PREFETCH, // a background thread prefetches the pages around the range passed to prefetch()
+    };
+};
+
+struct FileReadHint
+{
+    enum Enum: i32 {
+        CACHED = 0, // random access (UI), keep the blocks around
+        STREAM,     // one pass sequential scan (search), don't evict the UI blocks
+    };
+};
+
+/**
+ *  BlockCache
+ *  - fixed size blocks of the file, the least recently used block is evicted first
+ *  - block memory is allocated on first use and bounded by the budget
+ *  - not thread safe on its own, FileSource locks around it
+ */
+struct BlockCache
+{
+    struct Slot
+    {
+        u8* data = nullptr;
+        i64 blockId = -1;
+        i64 len = 0;
+        i32 prev = -1;
+        i32 next = -1;
+    };
+
+    i64 blockSize = 0;
+    i32 slotCapacity = 0;
+    Array<Slot> slots;
+    std::unordered_map<i64, i32> slotOfBlock;
+    i32 lruHead = -1; // most recently used
+    i32 lruTail = -1; // least recently used
+    i64 hitCount = 0;
+    i64 missCount = 0;
+
+    ~BlockCache() { release(); }
+
+    void init(i64 budget, i64 blockSize_);
+    void release();
+
+    // Returns the slot holding blockId (marked as most recently used) or nullptr
+    Slot* find(i64 blockId);
+    // Returns a slot for blockId, evicting the least recently used one if the budget is reached
+    Slot* insert(i64 blockId);
+
+    void _lruUnlink(i32 slotId);
+    void _lruPushFront(i32 slotId);
+};
+
+/**
+ *  FileSource
+ *  - read-only view of the opened file
+ *  - shared by the hex view, the tool windows and the search thread
+ *  - MAPPED is preferred, files over pagedMinSize go through the block cache (PAGED),
+ *    MEMORY is the fallback when the file can't be mapped
+ *  - data is only valid for MEMORY and MAPPED, use read() to support every kind
+ *  - opening doesn't block: MEMORY is read on a background thread, only the available() prefix
+ *    can be read while loading. MAPPED is never read whole, the pages around the range the view
+ *    asks for are prefetched instead
+ */
+struct FileSource
+{
+    FileSourceKind::Enum kind = FileSourceKind::NONE;
+    const u8* data = nullptr;
+    i64 size = 0;
+
+    GrowableBuffer memBuff;
+    mutable BlockCache cache;
+    struct SDL_mutex* cacheMutex = nullptr;
+#ifdef _WIN32
+    void* hFile = nullptr;
+    void* hMapping = nullptr;
+#else
+    i32 fd = -1;
+#endif
+
+    struct SDL_Thread* loadThread = nullptr;
+    std::atomic<i64> loadedSize{0};
+    std::atomic<bool> loading{false};
+    std::atomic<bool> loadCancel{false};
+
+    // prefetch window requested by the view, protected by prefetchMutex
+    struct SDL_mutex* prefetchMutex = nullptr;
+    struct SDL_cond* prefetchCond = nullptr;
+    mutable i64 prefetchStart = 0;
+    mutable i64 prefetchEnd = 0;
+    mutable bool prefetchPending = false;
+
+    ~FileSource() { close(); }
+
+    bool open(const char* path, i64 pagedMinSize, i64 cacheBudget);
+    bool openMapped(const char* path, FileMapMode::Enum mode = FileMapMode::LAZY);
+    bool openPaged(const char* path, i64 cacheBudget);
+    bool openMemory(const char* path);
+    void close();
+
+    // Copies [offset, offset+size) clamped to the file into dst, returns the copied byte count
+    i64 read(i64 offset, void* dst, i64 size_, FileReadHint::Enum hint = FileReadHint::CACHED) const;
+
+    // Same as read() but points straight into the file data when it is contiguous in memory,
+    // scratch must be able to hold size_ bytes otherwise. Returns nullptr if the range isn't fully readable
+    const u8* fetch(i64 offset, i64 size_, u8* scratch, FileReadHint::Enum hint = FileReadHint::CACHED) const;
+
+    // Hints that [offset, offset+size_) is about to be read, a PREFETCH mapping pages it in
+    // (and FILE_PREFETCH_AROUND on each side) in the background. No-op otherwise
+    void prefetch(i64 offset, i64 size_) const;
+
+    i64 _readRaw(i64 offset, void* dst, i64 size_) const;
+    bool _openHandle(const char* path);
+    void _closeHandle();
+    void _startLoading();
+    void _stopLoading();
+    void _startPrefetching();
+
+    inline bool isOpen() const {
+        return kind != FileSourceKind::NONE;
+    }
+
+    // Readable prefix of the file, grows while a MEMORY source is loading
+    inline i64 available() const {
+        if(kind == FileSourceKind::MEMORY) {
+            return loadedSize.load(std::memory_order_acquire);
+        }
+        return size;
+    }
+
+    inline bool isLoading() const {
+        return loading.load(std::memory_order_acquire);
+    }
+
+    inline f32 loadProgress() const {
+        return size > 0 ? (f64)loadedSize.load(std::memory_order_relaxed) / size : 1.0f;
+    }
+
+    inline bool isContiguous() const {
+        return kind == FileSourceKind::MEMORY || kind == FileSourceKind::MAPPED;
+    }
+
+    inline BufferSlice getSlice(i64 start, i64 size_) const {
+        assert(isContiguous());
+        assert(start >= 0);
+        assert(start + size_ <= size);
+        return BufferSlice{ (u8*)data + start, size_ };
+    }
+};
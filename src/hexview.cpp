@@ -2,6 +2,7 @@
 #include "bricks.h"
 #include "imgui_extended.h"
 #include "search.h"
+#include "file_source.h"
 #include <stdlib.h>
 #include <float.h>
 #include <limits.h>
@@ -124,15 +125,15 @@ HexView::~HexView()
 {
 }
 
-void HexView::setFileBuffer(u8* buff, i64 buffSize)
+void HexView::setFileSource(const FileSource* source)
 {
-	fileBuffer = buff;
-	fileBufferSize = buffSize;
+	fileSource = source;
+	fileBufferSize = source ? source->size : 0;
 	selection = {};
 	scrollCurrentLine = 0;
 }
 
-void HexView::setSearchResults(const ArrayTS<SearchResult>* searchResultList_)
+void HexView::setSearchResults(const SearchResultList* searchResultList_)
 {
 	searchResultList = searchResultList_;
 }
@@ -162,20 +163,27 @@ void HexView::removePanel(const i32 pid)
 	panelCount--;
 }
 
-void HexView::goTo(i32 offset)
+void HexView::goTo(i64 offset)
 {
 	if(offset >= 0 && offset < fileBufferSize) {
 		goToLine = offset / columnCount;
 	}
 }
 
-i32 HexView::getSelectedInt()
+i64 HexView::getSelectedInt()
 {
 	if(selection.selectStart > -1) {
 		i64 selMin = MIN(selection.selectStart, selection.selectEnd);
 		i64 selMax = MAX(selection.selectStart, selection.selectEnd);
 		if((selMax - selMin + 1) == 4) {
-			return *(i32*)(fileBuffer + selMin);
+			i32 val = 0;
+			fileSource->read(selMin, &val, sizeof(val));
+			return val;
+		}
+		if((selMax - selMin + 1) == 8) {
+			i64 val = 0;
+			fileSource->read(selMin, &val, sizeof(val));
+			return val;
 		}
 	}
 	return 0;
@@ -193,11 +201,11 @@ void HexView::doUiHexViewWindow()
 
 	bool mouseInsideAnyPanel = false;
 
-	if(!fileBuffer) {
+	if(!fileSource) {
 		return;
 	}
 
-	const i32 totalLineCount = fileBufferSize/columnCount + 4;
+	const i64 totalLineCount = fileBufferSize/columnCount + 4;
 	i32 panelMarkedForDelete = -1;
 	const f32 panelHeaderHeight = ImGui::GetComboHeight();
 	static i32 panelParamWindowOpenId = -1;
@@ -227,30 +235,36 @@ void HexView::doUiHexViewWindow()
 	for(i32 p = 0; p < panelCount; ++p)
 		windowWidth += panelRectWidth[p] + style.panelSpacing;
 
-	ImGui::SetNextWindowContentSize(ImVec2(windowWidth, totalLineCount * style.rowHeight));
+	// vertical scrolling is virtual (see DoScrollbarVertical), a float content height can't address
+	// every line of a huge file. ImGui only handles the horizontal scrollbar.
+	ImGui::SetNextWindowContentSize(ImVec2(windowWidth, 1));
 	ImGui::BeginChild("#child_panel", ImVec2(0, 0), false,
-					  ImGuiWindowFlags_HorizontalScrollbar);
+					  ImGuiWindowFlags_HorizontalScrollbar|ImGuiWindowFlags_NoScrollWithMouse);
 
 		// scrolling
 		ImGuiWindow* window = ImGui::GetCurrentWindow();
+		const i64 pageLineCount = window->Rect().GetHeight() / style.rowHeight;
 		if(goToLine != -1) {
-			ImGui::SetScrollY(goToLine * style.rowHeight);
+			scrollCurrentLine = goToLine;
 			goToLine = -1;
 		}
 
 		// TODO: change behaviour of keyboard scrolling.
 		// Count one key press the first 1 second, then count as key down (smooth scrolling)
 		if(ImGui::IsKeyDown(ImGui::GetIO().KeyMap[ImGuiKey_DownArrow]))
-			ImGui::SetScrollY(window->Scroll.y + style.rowHeight);
+			scrollCurrentLine += 1;
 		else if(ImGui::IsKeyDown(ImGui::GetIO().KeyMap[ImGuiKey_UpArrow]))
-			ImGui::SetScrollY(window->Scroll.y - style.rowHeight);
+			scrollCurrentLine -= 1;
 		else if(ImGui::IsKeyDown(ImGui::GetIO().KeyMap[ImGuiKey_PageDown]))
-			ImGui::SetScrollY(window->Scroll.y + 10 * style.rowHeight);
+			scrollCurrentLine += 10;
 		else if(ImGui::IsKeyDown(ImGui::GetIO().KeyMap[ImGuiKey_PageUp]))
-			ImGui::SetScrollY(window->Scroll.y - 10 * style.rowHeight);
+			scrollCurrentLine -= 10;
 
-		scrollCurrentLine = window->Scroll.y / style.rowHeight;
+		scrollCurrentLine = clamp(scrollCurrentLine, (i64)0, MAX(totalLineCount - pageLineCount, (i64)0));
 
+		// read visible data once for all the panels
+		readViewBuffer(scrollCurrentLine * columnCount - fileOffset,
+					   uiHexGetDisplayedBytesCount(fileBufferSize, columnCount));
 
 		// fill panel color buffers
 		for(i32 p = 0; p < panelCount; ++p) {
@@ -373,7 +387,9 @@ void HexView::doUiHexViewWindow()
 		// process mouse input over panels before displaying them
 		for(i32 p = 0; p < panelCount; ++p) {
 			ImGui::NextColumn(); // skip spacing column
-			mouseInsideAnyPanel |= uiHexPanelDoSelection(p, panelType[p], &selection, scrollCurrentLine * columnCount - fileOffset, columnCount);
+			if(!scrollbarHot) {
+				mouseInsideAnyPanel |= uiHexPanelDoSelection(p, panelType[p], &selection, scrollCurrentLine * columnCount - fileOffset, columnCount);
+			}
 			ImGui::NextColumn();
 		}
 
@@ -392,40 +408,40 @@ void HexView::doUiHexViewWindow()
 
 			switch(panelType[p]) {
 				case PanelType::HEX:
-					uiHexDoHexPanel(startOffset, fileBuffer, fileBufferSize, columnCount, panelColorBuffer[p]);
+					uiHexDoHexPanel(startOffset, viewBuffer.data, viewSize, columnCount, panelColorBuffer[p]);
 					break;
 				case PanelType::ASCII:
-					uiHexDoAsciiPanel(startOffset, fileBuffer, fileBufferSize, columnCount, panelColorBuffer[p]);
+					uiHexDoAsciiPanel(startOffset, viewBuffer.data, viewSize, columnCount, panelColorBuffer[p]);
 					break;
 				case PanelType::INT8:
-					uiHexDoFormatPanel<i8>(startOffset, fileBuffer, fileBufferSize, columnCount, panelColorBuffer[p], "%d");
+					uiHexDoFormatPanel<i8>(startOffset, viewBuffer.data, viewSize, columnCount, panelColorBuffer[p], "%d");
 					break;
 				case PanelType::UINT8:
-					uiHexDoFormatPanel<u8>(startOffset, fileBuffer, fileBufferSize, columnCount, panelColorBuffer[p], "%u");
+					uiHexDoFormatPanel<u8>(startOffset, viewBuffer.data, viewSize, columnCount, panelColorBuffer[p], "%u");
 					break;
 				case PanelType::INT16:
-					uiHexDoFormatPanel<i16>(startOffset, fileBuffer, fileBufferSize, columnCount, panelColorBuffer[p], "%d");
+					uiHexDoFormatPanel<i16>(startOffset, viewBuffer.data, viewSize, columnCount, panelColorBuffer[p], "%d");
 					break;
 				case PanelType::UINT16:
-					uiHexDoFormatPanel<u16>(startOffset, fileBuffer, fileBufferSize, columnCount, panelColorBuffer[p], "%u");
+					uiHexDoFormatPanel<u16>(startOffset, viewBuffer.data, viewSize, columnCount, panelColorBuffer[p], "%u");
 					break;
 				case PanelType::INT32:
-					uiHexDoFormatPanel<i32>(startOffset, fileBuffer, fileBufferSize, columnCount, panelColorBuffer[p], "%d");
+					uiHexDoFormatPanel<i32>(startOffset, viewBuffer.data, viewSize, columnCount, panelColorBuffer[p], "%d");
 					break;
 				case PanelType::UINT32:
-					uiHexDoFormatPanel<u32>(startOffset, fileBuffer, fileBufferSize, columnCount, panelColorBuffer[p], "%u");
+					uiHexDoFormatPanel<u32>(startOffset, viewBuffer.data, viewSize, columnCount, panelColorBuffer[p], "%u");
 					break;
 				case PanelType::INT64:
-					uiHexDoFormatPanel<i64>(startOffset, fileBuffer, fileBufferSize, columnCount, panelColorBuffer[p], "%lld");
+					uiHexDoFormatPanel<i64>(startOffset, viewBuffer.data, viewSize, columnCount, panelColorBuffer[p], "%lld");
 					break;
 				case PanelType::UINT64:
-					uiHexDoFormatPanel<u64>(startOffset, fileBuffer, fileBufferSize, columnCount, panelColorBuffer[p], "%llu");
+					uiHexDoFormatPanel<u64>(startOffset, viewBuffer.data, viewSize, columnCount, panelColorBuffer[p], "%llu");
 					break;
 				case PanelType::FLOAT32:
-					uiHexDoFormatPanel<f32>(startOffset, fileBuffer, fileBufferSize, columnCount, panelColorBuffer[p], "%g");
+					uiHexDoFormatPanel<f32>(startOffset, viewBuffer.data, viewSize, columnCount, panelColorBuffer[p], "%g");
 					break;
 				case PanelType::FLOAT64:
-					uiHexDoFormatPanel<f64>(startOffset, fileBuffer, fileBufferSize, columnCount, panelColorBuffer[p], "%g");
+					uiHexDoFormatPanel<f64>(startOffset, viewBuffer.data, viewSize, columnCount, panelColorBuffer[p], "%g");
 					break;
 				default:
 					assert(0);
@@ -435,6 +451,11 @@ void HexView::doUiHexViewWindow()
 			ImGui::NextColumn();
 		}
 
+		ImGui::Columns(1);
+
+		// drawn last to stay on top of the panels, applies next frame
+		scrollbarHot = ImGui::DoScrollbarVertical(&scrollCurrentLine, pageLineCount, totalLineCount);
+
 	ImGui::EndChild();
 	ImGui::PopStyleVar(1);
 
@@ -786,6 +807,27 @@ void DataPanels::doBrickPanel(const char* label, const i32 startLine)
 }
 #endif
 
+void HexView::readViewBuffer(i64 startOffset, i64 itemCount)
+{
+	// zero padded, typed panels read a whole T even on the last bytes
+	const i64 bufferSize = itemCount + sizeof(u64);
+	viewBuffer.reserve(bufferSize);
+	memset(viewBuffer.data, 0, bufferSize);
+
+	viewStart = startOffset;
+	// pages in the surroundings in the background so scrolling and goto don't stall on disk reads
+	fileSource->prefetch(startOffset, itemCount);
+
+	// only show what is loaded so far
+	viewSize = clamp(fileSource->available() - startOffset, (i64)0, itemCount);
+
+	// startOffset is negative when fileOffset shifts the view before the file start
+	const i64 skip = startOffset < 0 ? -startOffset : 0;
+	if(viewSize > skip) {
+		fileSource->read(startOffset + skip, viewBuffer.data + skip, viewSize - skip);
+	}
+}
+
 template<typename T>
 void HexView::fillColorBuffer(i32 panelID)
 {
@@ -833,8 +875,7 @@ void HexView::fillColorBuffer(i32 panelID)
 		}
 
 		for(; i < itemCount; i += sizeof(T)) {
-			const i64 dataOffset = i + startOffset;
-			const T val = *(T*)&(fileBuffer[dataOffset]);
+			const T val = *(T*)&(viewBuffer.data[i]);
 
 			u32 frameColor = 0xffffffff;
 			u32 textColor = 0xff000000;
@@ -867,45 +908,33 @@ void HexView::fillColorBuffer(i32 panelID)
 	}
 
 	// search
-	const i32 searchCount = searchResultList->count();
-	const ArrayTS<SearchResult>& searchList = *searchResultList;
+	const SearchResultList& searchList = *searchResultList;
 
 	const u32 searchFrameColor = style.searchHighlightFrameColor;
 	const u32 searchTextColor = style.searchHighlightTextColor;
 
-	// find approximate first and last search result, coresponding to viewed data range
-	i32 approxFirst = 0;
-	i32 approxLast = searchCount-1;
-	for(i32 s = 0; s < searchCount; s += 100)
-	{
-		const SearchResult& sr = searchList[s];
-		if(sr.offset+sr.len < startOffset) {
-			approxFirst = s;
-			continue;
-		}
-		if(sr.offset > endDataOff) {
-			approxLast = s;
-			break;
-		}
-	}
+	// only walk the results overlapping the viewed data range
+	i64 searchFirst, searchLast;
+	searchList.findOverlapping(startOffset, endDataOff, &searchFirst, &searchLast);
 
-	const i32 approxLast2 = approxLast;
-	for(i32 s = approxFirst; s < approxLast2; s++)
-	{
-		const SearchResult& sr = searchList[s];
-		if(sr.offset+sr.len <= startOffset)
-			continue;
-		if(sr.offset > endDataOff)
-			break;
+	if(searchFirst < searchLast) {
+		const bool multiPattern = searchList.isMultiPattern();
+		SearchResultList::Cursor cursor = searchList.seek(searchFirst);
 
-		i64 start = sr.offset - startOffset;
-		i64 end = start + sr.len;
+		while(true) {
+			const i64 len = cursor.len;
+			const i64 start = MAX(cursor.offset - startOffset, (i64)0);
+			const i64 end = MIN(cursor.offset + len - startOffset, itemCount);
+			// each pattern gets its own color
+			const u32 frameColor = multiPattern ? searchPatternColor(cursor.patternId) : searchFrameColor;
 
-		for(i64 i = start; i < end; i++) {
-			if(i < 0) continue;
-			if(i >= itemCount) break; // TODO: crop out of the loop
-			assert(i >= 0 && i < colorBuffer.capacity/sizeof(CellColor));
-			colorBuffer.data[i] = cellColorFromU32(searchFrameColor, searchTextColor);
+			for(i64 i = start; i < end; i++) {
+				assert(i >= 0 && i < colorBuffer.capacity/sizeof(CellColor));
+				colorBuffer.data[i] = cellColorFromU32(frameColor, searchTextColor);
+			}
+
+			if(cursor.index + 1 >= searchLast) break;
+			searchList.next(&cursor);
 		}
 	}
 
@@ -1066,17 +1095,17 @@ void uiHexColumnHeader(i32 columnCount, const SelectionState& selection)
 {
 	const UiStyle& style = getUiStyle();
 
-	i32 hoverStart = MIN(selection.hoverStart, selection.hoverEnd);
-	i32 hoverEnd = (MAX(selection.hoverStart, selection.hoverEnd)-1);
-	const i32 hoverSize = hoverEnd - hoverStart;
+	i64 hoverStart = MIN(selection.hoverStart, selection.hoverEnd);
+	i64 hoverEnd = (MAX(selection.hoverStart, selection.hoverEnd)-1);
+	const i64 hoverSize = hoverEnd - hoverStart;
 	hoverStart = hoverStart % columnCount;
 	hoverEnd = hoverStart + hoverSize;
 	if(hoverEnd > columnCount)
 		hoverStart = -1;
 	const bool hovered = hoverStart >= 0;
-	i32 selectStart = MIN(selection.selectStart, selection.selectEnd);
-	i32 selectEnd = MAX(selection.selectStart, selection.selectEnd);
-	const i32 selectSize = selectEnd - selectStart;
+	i64 selectStart = MIN(selection.selectStart, selection.selectEnd);
+	i64 selectEnd = MAX(selection.selectStart, selection.selectEnd);
+	const i64 selectSize = selectEnd - selectStart;
 	selectStart = selectStart % columnCount;
 	selectEnd = selectStart + selectSize;
 	if(selectEnd > columnCount)
@@ -1258,7 +1287,7 @@ void uiHexDoHexPanel(i64 startOffset, const u8* data, i64 dataSize, i32 columnCo
 		return;
 
 	const i32 lineCount = window->Rect().GetHeight() / style.rowHeight;
-	const i32 itemCount = MIN(dataSize - startOffset, lineCount * columnCount);
+	const i32 itemCount = MIN(dataSize, lineCount * columnCount);
 
 	i64 i = 0;
 
@@ -1292,8 +1321,7 @@ void uiHexDoHexPanel(i64 startOffset, const u8* data, i64 dataSize, i32 columnCo
 	// hex table
 	const i64 startI = i;
 	for(; i < itemCount; ++i) {
-		const i64 dataOffset = i + startOffset;
-		u8 val = data[dataOffset];
+		u8 val = data[i];
 		u32 hex = toHexStr(val);
 
 		u32 frameColor = 0xffffffff;
@@ -1335,7 +1363,7 @@ void uiHexDoAsciiPanel(i64 startOffset, const u8* data, i64 dataSize, i32 column
 		return;
 
 	const i32 lineCount = window->Rect().GetHeight() / style.rowHeight;
-	const i32 itemCount = MIN(dataSize - startOffset, lineCount * columnCount);
+	const i32 itemCount = MIN(dataSize, lineCount * columnCount);
 
 	ImGui::PushFont(style.fontAscii);
 
@@ -1358,8 +1386,7 @@ void uiHexDoAsciiPanel(i64 startOffset, const u8* data, i64 dataSize, i32 column
 
 	const i64 startI = i;
 	for(; i < itemCount; ++i) {
-		const i64 dataOff = i + startOffset;
-		const char c = (char)data[dataOff];
+		const char c = (char)data[i];
 		i32 line = i / columnCount;
 		i32 column = i % columnCount;
 		ImRect bb(winPos.x + column * style.asciiCharWidth, winPos.y + line * style.rowHeight,
@@ -1416,28 +1443,13 @@ void uiHexDoFormatPanel(i64 startOffset, const u8* data, i64 dataSize, i32 colum
 	const i32 bitSize = byteSize << 3;
 
 	const i32 lineCount = window->Rect().GetHeight() / style.rowHeight;
-	i64 itemCount = (MIN(dataSize - startOffset, lineCount * columnCount) / byteSize) * byteSize;
+	i64 itemCount = (MIN(dataSize, lineCount * columnCount) / byteSize) * byteSize;
 
 	const ImVec2 cellSize(style.intColumnWidth * byteSize, style.rowHeight);
 
 	for(i64 i = 0; i < itemCount; i += byteSize) {
-		const i64 dataOff = i + startOffset;
-		T val;
-
-		// fill bytes with 0 when startOffset < 0
-		// TODO: get out of that loop
-		if(dataOff < 0) {
-			u8 val8[sizeof(T)];
-			for(i64 j = 0; j < byteSize; j++) {
-				if(dataOff + j < 0) val8[j] = 0;
-				else val8[j] = *(u8*)&data[dataOff + j];
-			}
-
-			val = *(T*)val8;
-		}
-		else {
-			val = *(T*)&data[dataOff];
-		}
+		// bytes before the file start are zeroed in the view buffer
+		const T val = *(T*)&data[i];
 
 		char integerStr[32];
 		sprintf(integerStr, format, val);
@@ -161,7 +161,7 @@ struct PanelParams
     }
 };
 
-struct SearchResult;
+struct SearchResultList;
 
 struct HexView
 {
@@ -170,30 +170,36 @@ struct HexView
 	CellColorBuffer panelColorBuffer[PANEL_MAX_COUNT];
     i32 panelCount = 3;
 
-    u8* fileBuffer;
-    i64 fileBufferSize;
-    i64 scrollCurrentLine = 0;
+    const struct FileSource* fileSource = nullptr;
+    i64 fileBufferSize = 0;
+    GrowableBuffer viewBuffer; // visible bytes, read from fileSource each frame
+    i64 viewStart = 0;
+    i64 viewSize = 0;
+    i64 scrollCurrentLine = 0; // top line, scrolling is virtual past float precision
     i64 goToLine = -1;
+    bool scrollbarHot = false;
     struct BrickWall* brickWall = nullptr;
 
     i32 columnCount = 16;
-	i32 fileOffset = 0;
+	i64 fileOffset = 0;
 	SelectionState selection;
 
-	const ArrayTS<SearchResult>* searchResultList = nullptr;
+	const SearchResultList* searchResultList = nullptr;
 
 	HexView();
 	~HexView();
-    void setFileBuffer(u8* buff, i64 buffSize);
-	void setSearchResults(const ArrayTS<SearchResult>* searchResultList_);
+    void setFileSource(const struct FileSource* source);
+	void setSearchResults(const SearchResultList* searchResultList_);
     void addNewPanel();
     void removePanel(const i32 pid);
-    void goTo(i32 offset);
-    i32 getSelectedInt();
+    void goTo(i64 offset);
+    i64 getSelectedInt();
 
 	void doUiHexViewWindow();
     void doPanelParamPopup(bool open, i32* panelId, ImVec2 popupPos);
 
+	void readViewBuffer(i64 startOffset, i64 itemCount);
+
 	template<typename T>
 	void fillColorBuffer(i32 panelID);
 
@@ -237,6 +243,7 @@ void uiHexColumnHeader(i32 columnCount, const SelectionState& selection);
 bool uiHexPanelDoSelection(i32 panelID, i32 panelType, SelectionState* outSelectionState, i64 startOffset, i32 columnCount);
 void uiHexPanelTypeDoSelection(SelectionState* outSelectionState, i32 panelId, ImVec2 mousePos, ImRect rect, i32 columnWidth_, i32 rowHeight_, i64 startOffset, i32 columnCount, i32 hoverLen);
 
+// data points to the visible bytes (file offset startOffset), dataSize is how many of them are in the file
 void uiHexDoHexPanel(i64 startOffset, const u8* data, i64 dataSize, i32 columnCount, const CellColorBuffer &pColorBuffer);
 
 void uiHexDoAsciiPanel(i64 startOffset, const u8* data, i64 dataSize, i32 columnCount, const CellColorBuffer &colorBuffer);
@@ -7,10 +7,16 @@
 
 namespace ImGui {
 
-void DoScrollbarVertical(i64* outScrollVal, i64 scrollPageSize, i64 scrollTotalSize)
+// Scroll values are i64 and the grab position is computed in f64, so this stays exact way past
+// the float precision limit of regular ImGui scrolling (huge files).
+// Dragging the grab is relative and nonlinear: the further the mouse is moved away from the
+// scrollbar horizontally, the slower it scrolls, down to one unit per pixel.
+// Returns true when the scrollbar is hovered or held.
+bool DoScrollbarVertical(i64* outScrollVal, i64 scrollPageSize, i64 scrollTotalSize)
 {
     if(scrollPageSize >= scrollTotalSize) {
-        return;
+        *outScrollVal = 0;
+        return false;
     }
 
     ImGuiContext& g = *GImGui;
@@ -18,18 +24,17 @@ void DoScrollbarVertical(i64* outScrollVal, i64 scrollPageSize, i64 scrollTotalS
     const ImGuiStyle& style = g.Style;
     const ImGuiID id = window->GetID("#SCROLLY");
     i64& scrollVal = *outScrollVal;
+    const i64 scrollMax = scrollTotalSize - scrollPageSize;
 
     ImRect winRect = window->Rect();
+    winRect.Max.y -= window->ScrollbarSizes.y; // horizontal scrollbar
     winRect.Expand(ImVec2(0, -2.f)); // padding
-    window->ContentsRegionRect.Max.x += style.ScrollbarSize;
 
     // Render background
     ImRect bb = winRect;
     bb.Min.x = bb.Max.x - style.ScrollbarSize;
     ImRect bbBg = bb;
 
-    int window_rounding_corners;
-    window_rounding_corners = ImDrawCornerFlags_TopRight|ImDrawCornerFlags_BotRight;
     window->DrawList->AddRectFilled(bb.Min, bb.Max, ImGui::GetColorU32(ImGuiCol_ScrollbarBg),
                                     window->WindowRounding, 0);
 
@@ -42,62 +47,68 @@ void DoScrollbarVertical(i64* outScrollVal, i64 scrollPageSize, i64 scrollTotalS
         height = minGrabHeight;
     }
 
-    //LOG("height=%.5f pageSize=%llu contentSize=%llu", height, pageSize, contentSize);
+    // units scrolled per pixel when dragging straight along the scrollbar
+    const f64 unitsPerPixel = (f64)scrollTotalSize / scrollSurfaceSizeY;
+
     f32 yOffset = scrollSurfaceSizeY * ((f64)scrollVal / scrollTotalSize);
     bb = ImRect(bbBg.Min.x + 2.0f, bbBg.Min.y + yOffset, bbBg.Max.x - 2.0f, bbBg.Min.y + yOffset + height);
-    /*bb.Expand(ImVec2(-ImClamp((float)(int)((bb.Max.x - bb.Min.x - 2.0f) * 0.5f), 0.0f, 3.0f),
-                     -ImClamp((float)(int)((bb.Max.y - bb.Min.y - 2.0f) * 0.5f), 0.0f, 3.0f)));*/
+
     bool held = false;
     bool hovered = false;
     const bool previouslyHeld = (g.ActiveId == id);
-    ButtonBehavior(bb, id, &hovered, &held);
+    ButtonBehavior(bbBg, id, &hovered, &held);
 
-    static f32 mouseGrabDeltaY = 0;
+    static f64 dragRemainder = 0;
+    static f64 wheelRemainder = 0;
 
     if(held) {
         if(!previouslyHeld) {
-            f32 my = g.IO.MousePos.y;
-            my -= bb.Min.y;
-            mouseGrabDeltaY = my;
-        }
-
-        f32 my = g.IO.MousePos.y;
-        my -= bbBg.Min.y;
-        my -= mouseGrabDeltaY;
-        scrollVal = (my/scrollSurfaceSizeY) * (f64)scrollTotalSize;
+            dragRemainder = 0;
 
-        // clamp
-        if(scrollVal < 0) {
-            scrollVal = 0;
+            // clicked outside the grab: seek there
+            const f32 my = g.IO.MousePos.y;
+            if(my < bb.Min.y || my > bb.Max.y) {
+                const f64 ratio = (my - bbBg.Min.y - height * 0.5f) / scrollSurfaceSizeY;
+                scrollVal = (i64)(ratio * scrollTotalSize);
+            }
         }
-        else if(scrollVal > (scrollTotalSize - scrollPageSize)) {
-            scrollVal = scrollTotalSize - scrollPageSize;
+        else {
+            const f32 distX = ImMax(0.0f, bbBg.Min.x - g.IO.MousePos.x);
+            const f64 slowdown = 1.0 + distX / 50.0;
+            const f64 speed = ImMax(1.0, unitsPerPixel / (slowdown * slowdown * slowdown));
+
+            dragRemainder += g.IO.MouseDelta.y * speed;
+            const i64 delta = (i64)dragRemainder;
+            dragRemainder -= delta;
+            scrollVal += delta;
         }
     }
     else {
         // TODO: find a better place for this?
-        ImGuiWindow* hovered = g.HoveredWindow;
-        if(hovered && hovered != window) { // go up one level
-            hovered = hovered->ParentWindow;
+        ImGuiWindow* hoveredWin = g.HoveredWindow;
+        if(hoveredWin && hoveredWin != window) { // go up one level
+            hoveredWin = hoveredWin->ParentWindow;
         }
 
-        if(hovered && hovered == window && g.IO.MouseWheel != 0.0f) {
-            scrollVal -= g.IO.MouseWheel;
-
-            // clamp
-            if(scrollVal < 0) {
-                scrollVal = 0;
-            }
-            else if(scrollVal > (scrollTotalSize - scrollPageSize)) {
-                scrollVal = scrollTotalSize - scrollPageSize;
-            }
+        if(hoveredWin && hoveredWin == window && g.IO.MouseWheel != 0.0f) {
+            wheelRemainder -= g.IO.MouseWheel * 3.0;
+            const i64 delta = (i64)wheelRemainder;
+            wheelRemainder -= delta;
+            scrollVal += delta;
         }
     }
 
+    scrollVal = clamp(scrollVal, (i64)0, scrollMax);
+
+    // grab position after this frame's update
+    yOffset = scrollSurfaceSizeY * ((f64)scrollVal / scrollTotalSize);
+    bb = ImRect(bbBg.Min.x + 2.0f, bbBg.Min.y + yOffset, bbBg.Max.x - 2.0f, bbBg.Min.y + yOffset + height);
+
     const ImU32 grab_col = ImGui::GetColorU32(held ? ImGuiCol_ScrollbarGrabActive : hovered ?
                                               ImGuiCol_ScrollbarGrabHovered : ImGuiCol_ScrollbarGrab);
 
     window->DrawList->AddRectFilled(bb.Min, bb.Max, grab_col, style.ScrollbarRounding);
+    return hovered || held;
 }
 
 f32 GetComboHeight()
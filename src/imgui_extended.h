@@ -4,7 +4,7 @@
 
 namespace ImGui {
 
-void DoScrollbarVertical(i64* outScrollVal, i64 scrollPageSize, i64 scrollTotalSize);
+bool DoScrollbarVertical(i64* outScrollVal, i64 scrollPageSize, i64 scrollTotalSize);
 
 f32 GetComboHeight();
 
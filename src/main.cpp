@@ -2,6 +2,9 @@
 #include <SDL.h>
 #ifdef _WIN32
     #include <windows.h>
+    #include <io.h>
+#else
+    #include <unistd.h>
 #endif
 
 #include <stdio.h>
@@ -14,6 +17,10 @@
 #include "bricks.h"
 #include "script.h"
 #include "search.h"
+#include "search_index.h"
+#include "search_suffix.h"
+#include "search_kernel.h"
+#include "file_source.h"
 
 #ifdef OXED_PROFILE
 #include <easy/profiler.h>
@@ -35,12 +42,13 @@
 #define WINDOW_BASE_TITLE "0xed"
 
 #define POPUP_BRICK_ADD "Add brick"
+#define SEARCH_FINDER_FRAME_BUDGET (16 * 1024 * 1024) // bytes scanned per frame by find next / previous
 
 struct Application {
 
 AppWindow win;
 Config config;
-GrowableBuffer curFileBuff;
+FileSource fileSource;
 HexView hexView;
 BrickWall brickWall;
 
@@ -53,7 +61,17 @@ i64 popupBrickSelLength;
 Script script;
 SearchParams searchParams = {};
 SearchParams lastSearchParams = {};
-ArrayTS<SearchResult> searchResults;
+SearchOutput searchOutput;
+SearchOutput lastSearchOutput;
+SearchResultList searchResults;
+SearchIndex searchIndex;
+SearchSuffixArray suffixArray;
+SearchFinder searchFinder;
+bool searchFinderMissed = false;
+i64 searchFinderSelStart = -1; // selection made by the last hit, F3 keeps the query while it's unchanged
+i64 searchFinderSelEnd = -1;
+char suffixSpillPath[256];
+Array<SearchRange> searchRanges;
 
 bool init()
 {
@@ -76,6 +94,16 @@ bool init()
 	static char imguiIniPath[256];
 	pathRelative(imguiIniPath, sizeof(imguiIniPath), "0xed_imgui.ini");
 
+	// one spill file per instance, closing one must not delete the file of another
+#ifdef _WIN32
+	const u32 pid = GetCurrentProcessId();
+#else
+	const u32 pid = getpid();
+#endif
+	char spillName[64];
+	snprintf(spillName, sizeof(spillName), "0xed_suffix_%u.tmp", pid);
+	pathRelative(suffixSpillPath, sizeof(suffixSpillPath), spillName);
+
     if(!win.init(WINDOW_BASE_TITLE, config.windowWidth, config.windowHeight,
 				 config.windowMaximized, imguiIniPath)) {
         return false;
@@ -88,16 +116,14 @@ bool init()
         this->handleEvent(e);
     };
 
-	hexView.fileBuffer = 0;
-	hexView.fileBufferSize = 0;
 	hexView.panelCount = clamp(config.panelCount, 1, PANEL_MAX_COUNT);
 	hexView.brickWall = &brickWall;
 
 	// init style
 	setUiStyleLight(win.fontMono);
 
-	searchResults.reserve(1024);
 	searchStartThread();
+	searchSetIndex(&searchIndex);
 
 	/*lastSearchParams.dataType = SearchDataType::ASCII_String;
 	lastSearchParams.dataSize = 3;
@@ -146,10 +172,9 @@ void cleanUp()
 
 	searchTerminateThread();
 
-    if(curFileBuff.data) {
-        free(curFileBuff.data);
-        curFileBuff.data = nullptr;
-    }
+	searchIndex.close();
+	suffixArray.close();
+	fileSource.close();
 }
 
 i32 run()
@@ -180,6 +205,10 @@ void handleEvent(const SDL_Event& event)
             case SDLK_b:
                 userTryAddBrick();
                 break;
+
+            case SDLK_F3:
+                userFind((event.key.keysym.mod & KMOD_SHIFT) != 0);
+                break;
         }
         return;
     }
@@ -195,6 +224,40 @@ void userTryAddBrick()
     popupBrickWantOpen = true;
 }
 
+// Next / previous occurrence of the selected bytes, or of the last search when nothing is selected.
+// While the selection is the last hit the same query goes on (wildcards, case and stride included)
+void userFind(bool backward)
+{
+	if(!fileSource.isOpen()) return;
+
+	const SelectionState& sel = hexView.selection;
+	i64 from;
+	bool started;
+	if(!sel.isEmpty() && sel.selectStart == searchFinderSelStart && sel.selectEnd == searchFinderSelEnd) {
+		from = searchFinderSelStart;
+		searchFinder.restart(from, backward);
+		started = true;
+	}
+	else if(!sel.isEmpty()) {
+		const i64 selMin = MIN(hexView.selection.selectStart, hexView.selection.selectEnd);
+		const i64 selMax = MAX(hexView.selection.selectStart, hexView.selection.selectEnd);
+		u8 data[SEARCH_NEEDLE_MAX_LEN];
+		u8 mask[SEARCH_NEEDLE_MAX_LEN];
+		const i32 len = fileSource.read(selMin, data, MIN(selMax - selMin + 1, SEARCH_NEEDLE_MAX_LEN));
+		if(len <= 0) return;
+		memset(mask, 0xFF, len);
+		from = selMin;
+		searchFinder.start(data, mask, len, 1, from, backward);
+		started = true;
+	}
+	else {
+		// the top of the view is a match candidate when looking forward
+		from = backward ? hexView.fileOffset : hexView.fileOffset - 1;
+		started = searchFinder.startParams(lastSearchParams, from, backward);
+	}
+	searchFinderMissed = !started;
+}
+
 static void setStyleLight()
 {
     ImGui::StyleColorsLight();
@@ -215,29 +278,31 @@ static void setStyleLight()
 
 bool fileLoad(const char* filename)
 {
-	win.setCursorWait();
-
-	const i32 fileOffsetMax = 32;
-
-	curFileBuff.clear();
-	if(!openFileReadAll(filename, &curFileBuff)) {
+	// make sure the search thread lets go of the current file before unmapping it
+	searchSetNewFileSource(nullptr);
+	searchResults.clear();
+	searchIndex.close();
+	suffixArray.close();
+	searchFinder.active = false;
+	searchFinderSelStart = -1;
+	searchFinderSelEnd = -1;
+	hexView.setFileSource(nullptr);
+
+	if(!fileSource.open(filename, (i64)config.pagedFileMinSizeMb * 1024 * 1024,
+						(i64)config.cacheBudgetMb * 1024 * 1024)) {
 		LOG("ERROR: failed to load '%s'", filename);
+		win.setTitle(WINDOW_BASE_TITLE);
 		return false;
 	}
 
-	curFileBuff.size--; // hacky, make size == fileSize
-
-	searchResults.clear();
-
-	hexView.setFileBuffer((u8*)curFileBuff.data, curFileBuff.size);
-	searchSetNewFileBuffer(curFileBuff.getSlice(0, curFileBuff.size));
+	hexView.setFileSource(&fileSource);
+	searchSetNewFileSource(&fileSource);
+	searchIndex.open(&fileSource, filename);
 
 	char title[256];
 	snprintf(title, sizeof(title), "%s :: 0xed", pathGetFilename(filename));
 	win.setTitle(title);
 
-	win.setCursorDefault();
-
 	return true;
 }
 
@@ -266,6 +331,18 @@ void doUI()
 	ImGui::DockSpace(dockspaceMain, ImVec2(0.0f, 0.0f), ImGuiDockNodeFlags_None|ImGuiDockNodeFlags_AutoHideTabBar);
 	const ImVec2 mainDockSize = ImGui::GetContentRegionAvail();
 
+	// find next / previous, a slice of the file per frame
+	if(searchFinder.active && searchFinder.step(fileSource, SEARCH_FINDER_FRAME_BUDGET)) {
+		if(searchFinder.found >= 0) {
+			const i64 found = searchFinder.found;
+			hexView.goTo(found);
+			searchFinderSelStart = found;
+			searchFinderSelEnd = found + searchFinder.horspool.len - 1;
+			hexView.selection.select(searchFinderSelStart, searchFinderSelEnd);
+		}
+		searchFinderMissed = searchFinder.found < 0;
+	}
+
 	// menu bar
 	bool openGoto = false;
 	bool openSearch = false;
@@ -281,6 +358,12 @@ void doUI()
 			if(ImGui::MenuItem("Search", "CTRL+F")) {
 				openSearch = true;
 			}
+			if(ImGui::MenuItem("Find next", "F3")) {
+				userFind(false);
+			}
+			if(ImGui::MenuItem("Find previous", "SHIFT+F3")) {
+				userFind(true);
+			}
 			if(ImGui::MenuItem("Exit", "CTRL+X")) {
 				win.exit();
 			}
@@ -301,6 +384,25 @@ void doUI()
 			openGoto = true;
 		}
 
+		if(fileSource.isLoading()) {
+			char progressStr[64];
+			snprintf(progressStr, sizeof(progressStr), "Loading %.0f%%", fileSource.loadProgress() * 100.0f);
+			ImGui::ProgressBar(fileSource.loadProgress(), ImVec2(200, 0), progressStr);
+		}
+
+		if(searchFinder.active) {
+			char progressStr[64];
+			const f32 progress = searchFinder.progress(fileSource.available());
+			snprintf(progressStr, sizeof(progressStr), "Finding %.0f%%", progress * 100.0f);
+			ImGui::ProgressBar(progress, ImVec2(200, 0), progressStr);
+			if(ImGui::Button("Stop")) {
+				searchFinder.active = false;
+			}
+		}
+		else if(searchFinderMissed) {
+			ImGui::TextUnformatted("Not found");
+		}
+
 		ImGui::EndMainMenuBar();
 	}
 
@@ -314,7 +416,7 @@ void doUI()
 	// Tool windows
 
 	// Inspector
-	toolsDoInspectorWindow(curFileBuff.data, curFileBuff.size, hexView.selection);
+	toolsDoInspectorWindow(fileSource, hexView.selection);
 
 	// Search
 	ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(10, 10));
@@ -322,23 +424,31 @@ void doUI()
 	ImGui::PopStyleVar(1);
 
 		// search params
-		if(toolsSearchParams(&searchParams)) {
-			searchResults.clear();
+		if(toolsSearchParams(&searchParams, &searchOutput, brickWall)) {
 			lastSearchParams = searchParams;
-			searchNewRequest(lastSearchParams, &searchResults);
+			lastSearchOutput = searchOutput;
+			const bool scoped = toolsSearchRanges(lastSearchParams, hexView.selection, brickWall, &searchRanges);
+			searchNewRequest(lastSearchParams, &searchResults, scoped ? &searchRanges : nullptr, &lastSearchOutput);
+		}
+		i64 searchGotoOffset;
+		i32 searchGotoLen;
+		toolsSearchIndex(&searchIndex);
+		if(toolsSuffixArray(&suffixArray, fileSource, hexView.selection, suffixSpillPath, &searchGotoOffset,
+							&searchGotoLen)) {
+			hexView.goTo(searchGotoOffset);
+			hexView.selection.select(searchGotoOffset, searchGotoOffset + searchGotoLen - 1);
 		}
 		// search results here
-		u64 searchGotoOffset;
-		if(toolsSearchResults(lastSearchParams, searchResults, &searchGotoOffset)) {
+		if(toolsSearchResults(lastSearchParams, lastSearchOutput, searchResults, &searchGotoOffset, &searchGotoLen)) {
 			hexView.goTo(searchGotoOffset);
-			hexView.selection.select(searchGotoOffset, searchGotoOffset + lastSearchParams.dataSize - 1);
+			hexView.selection.select(searchGotoOffset, searchGotoOffset + searchGotoLen - 1);
 		}
 		ImGuiWindow* searchWindow = ImGui::GetCurrentWindowRead();
 
 	ImGui::End();
 
 	// Brick wall
-	uiBrickWallWindow(&brickWall, curFileBuff.data);
+	uiBrickWallWindow(&brickWall, fileSource);
 
 	// Scripts
 	ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0.0f, 0.0f));
@@ -370,7 +480,7 @@ void doUI()
 	}
 #endif
 
-    static i32 gotoOffset = 0;
+    static i64 gotoOffset = 0;
     if(openGoto) {
         ImGui::OpenPopup("Go to file offset");
 		gotoOffset = hexView.getSelectedInt();
@@ -379,7 +489,7 @@ void doUI()
         ImGui::Text("Go to");
         ImGui::Separator();
 
-        ImGui::InputInt("##offset", &gotoOffset);
+        ImGui::InputScalar("##offset", ImGuiDataType_S64, &gotoOffset, NULL, NULL, "%lld");
 
         if(ImGui::Button("OK", ImVec2(120,0))) {
 			hexView.goTo(gotoOffset);
@@ -410,10 +520,144 @@ void doUI()
 };
 
 
+#ifdef _WIN32
+static bool isRedirected(DWORD stdHandle)
+{
+	const DWORD type = GetFileType(GetStdHandle(stdHandle));
+	return type == FILE_TYPE_DISK || type == FILE_TYPE_PIPE;
+}
+#endif
+
+// 0xed is a WindowedApp, it has no console of its own. Headless runs attach to the console of the shell that
+// started them, redirected outputs (files, pipes) are inherited and kept.
+static void headlessAttachConsole()
+{
+#ifdef _WIN32
+	const bool outRedirected = isRedirected(STD_OUTPUT_HANDLE);
+	const bool errRedirected = isRedirected(STD_ERROR_HANDLE);
+	if(!AttachConsole(ATTACH_PARENT_PROCESS)) {
+		return;
+	}
+	if(!outRedirected) {
+		freopen("CONOUT$", "w", stdout);
+	}
+	if(!errRedirected) {
+		freopen("CONOUT$", "w", stderr);
+	}
+#endif
+}
+
+// LOG prints to stdout, it is moved to stderr. Returns the original stdout, where only the result goes
+static FILE* headlessResultStream()
+{
+	fflush(stdout);
+#ifdef _WIN32
+	const i32 fd = _dup(_fileno(stdout));
+	if(fd < 0) {
+		return stdout;
+	}
+	_dup2(_fileno(stderr), _fileno(stdout));
+	return _fdopen(fd, "w");
+#else
+	const i32 fd = dup(fileno(stdout));
+	if(fd < 0) {
+		return stdout;
+	}
+	dup2(fileno(stderr), fileno(stdout));
+	return fdopen(fd, "w");
+#endif
+}
+
+#define HEADLESS_USAGE "usage: 0xed file --count [--hex] pattern\n" \
+					   "       0xed file --export [--hex] pattern out.bin|out.csv\n" \
+					   "pattern is a string, or hex bytes with --hex (\"4D 5A ?? 00\")"
+
+// Prints the match count of pattern, --export also writes the matches to a file.
+// Diagnostics go to stderr, stdout only gets the count.
+static i32 searchHeadless(i32 argc, char** argv)
+{
+	headlessAttachConsole();
+	FILE* result = headlessResultStream();
+
+	const bool exporting = strcmp(argv[2], "--export") == 0;
+	const bool hex = strcmp(argv[3], "--hex") == 0;
+	const i32 argPattern = hex ? 4 : 3;
+	if(argc != argPattern + (exporting ? 2 : 1)) {
+		LOG(HEADLESS_USAGE);
+		return 1;
+	}
+
+	SearchParams params;
+	const char* pattern = argv[argPattern];
+	u8 data[SEARCH_NEEDLE_MAX_LEN];
+	u8 mask[SEARCH_NEEDLE_MAX_LEN];
+	if(hex) {
+		if(strlen(pattern) >= sizeof(params.maskedPattern)) {
+			LOG("ERROR: pattern is too long (%d characters max)", (i32)sizeof(params.maskedPattern) - 1);
+			return 1;
+		}
+		params.dataType = SearchDataType::Masked_Pattern;
+		snprintf(params.maskedPattern, sizeof(params.maskedPattern), "%s", pattern);
+		params.dataSize = searchParseMaskedPattern(pattern, data, mask, SEARCH_NEEDLE_MAX_LEN);
+	}
+	else {
+		if(strlen(pattern) >= sizeof(params.str)) {
+			LOG("ERROR: pattern is too long (%d characters max)", (i32)sizeof(params.str) - 1);
+			return 1;
+		}
+		params.dataType = SearchDataType::ASCII_String;
+		snprintf(params.str, sizeof(params.str), "%s", pattern);
+		params.dataSize = searchEncodeString(params, data, mask, SEARCH_NEEDLE_MAX_LEN);
+	}
+	if(params.dataSize <= 0) {
+		LOG("ERROR: invalid pattern '%s'", pattern);
+		return 1;
+	}
+
+	const Config config;
+	FileSource source;
+	if(!source.open(argv[1], (i64)config.pagedFileMinSizeMb * 1024 * 1024,
+					(i64)config.cacheBudgetMb * 1024 * 1024)) {
+		LOG("ERROR: failed to load '%s'", argv[1]);
+		return 1;
+	}
+
+	SearchOutput output;
+	if(exporting) {
+		const char* outPath = argv[argPattern + 1];
+		const i32 outLen = (i32)strlen(outPath);
+		if(outLen >= (i32)sizeof(output.path)) {
+			LOG("ERROR: output path is too long");
+			return 1;
+		}
+		output.kind = SearchOutput::Stream;
+		output.format = outLen > 4 && strcmp(outPath + outLen - 4, ".csv") == 0 ? SearchOutput::Csv : SearchOutput::Binary;
+		snprintf(output.path, sizeof(output.path), "%s", outPath);
+	}
+	else {
+		output.kind = SearchOutput::Count;
+	}
+
+	searchStartThread();
+	searchSetNewFileSource(&source);
+	SearchResultList results; // stays empty
+	searchNewRequest(params, &results, nullptr, &output);
+	const bool complete = searchWait();
+	fprintf(result, "%lld\n", searchFoundCount());
+	fflush(result);
+	searchSetNewFileSource(nullptr);
+	searchTerminateThread();
+	return complete ? 0 : 1;
+}
+
 int main(int argc, char** argv)
 {
     SDL_SetMainReady();
 
+	if(argc >= 4 && (strcmp(argv[2], "--count") == 0 || strcmp(argv[2], "--export") == 0)) {
+		return searchHeadless(argc, argv);
+	}
+
 	LOG(".: 0xed :.");
 
 #ifdef OXED_PROFILE
@@ -1,128 +1,1590 @@
 #include "search.h"
+#include "file_source.h"
+#include "search_kernel.h"
+#include "search_multi.h"
+#include "search_regex.h"
+#include "search_approx.h"
+#include "search_index.h"
 #include <SDL_thread.h>
+#include <SDL_mutex.h>
 #include <SDL_timer.h>
+#include <SDL_cpuinfo.h>
+#include <atomic>
+#include <algorithm>
 
+/**
+ *  SearchQueue
+ *  - holds the pending request, the search thread sleeps on cond until one arrives
+ *  - every request or cancel bumps generation, a running search stops as soon as it no longer matches
+ *  - remembers the last search that ran to completion. A narrower request moves its results to refineBase
+ *    and only re-checks those, refineBase stays valid while the requests keep narrowing it
+ *  - everything but generation is guarded by mutex
+ */
 struct SearchQueue
 {
-    bool8 running = true;
-    u32 searchHashCurrent = 0;
-    u32 searchHashRequest = 0;
-	ArrayTS<SearchResult>* resultListCurrent = nullptr;
-	ArrayTS<SearchResult>* resultListRequest = nullptr;
-    SearchParams paramsCurrent;
+    SDL_mutex* mutex = nullptr;
+    SDL_cond* cond = nullptr;
+    std::atomic<bool> running{true}; // also read by the workers
+    bool pending = false; // a request is waiting for the search thread
+    bool busy = false;    // the search thread is searching
+    std::atomic<u32> generation{0};
+
+	SearchResultList* resultListRequest = nullptr;
     SearchParams paramsRequest;
-	BufferSlice fileBuff;
+    Array<SearchRange> rangesRequest;
+    SearchOutput outputRequest;
+    std::atomic<i64> foundCount{0}; // merged results of the current request, also read by the UI
+    bool lastComplete = false;
+	const FileSource* fileSource = nullptr;
+    const SearchIndex* index = nullptr;
+
+    const SearchResultList* completeList = nullptr; // null if the last search didn't complete
+    i64 completeCount = 0; // the list may have been cleared since
+    SearchParams completeParams;
+    Array<SearchRange> completeRanges;
+
+    bool refineBaseValid = false;
+    const SearchResultList* refineBaseList = nullptr; // list the base was taken from
+    SearchParams refineBaseParams;
+    Array<SearchRange> refineBaseRanges;
+    SearchResultList refineBase; // only touched by the search thread while busy
+};
+
+// the file is split in chunks searched in parallel, chunks overlap by the search data size
+#define SEARCH_CHUNK_SIZE (4 * 1024 * 1024)
+// chunks searched ahead of the merge, bounds the memory held by unmerged results
+#define SEARCH_CHUNK_RING_SIZE 64
+// the kernel is called on slices this big so a cancel is noticed quickly
+#define SEARCH_SLICE_SIZE (256 * 1024)
+#define SEARCH_MAX_WORKERS 64
+#define SEARCH_MAX_RESULTS 1000000000LL
+
+struct SearchMethod
+{
+    enum Enum: i32 {
+        NEEDLE = 0, // one byte sequence with an optional bit mask, rare byte SIMD scan
+        AUTOMATON,  // pattern set, Aho-Corasick
+        REGEX,      // lazy DFA, leftmost longest matches
+        NUMERIC,    // integer or float predicate at each stride position
+        RELATIVE,   // same differences between consecutive values as a word
+        APPROX,     // at most k differences with one pattern, bit-parallel
+    };
+};
+
+// piece of a search range, matches start in [start, end) and end at or before needed
+struct SearchSpan
+{
+    i64 start;
+    i64 end;
+    i64 needed;
+};
+
+// consecutive spans, small ones are grouped so a chunk is about SEARCH_CHUNK_SIZE bytes
+struct SearchChunk
+{
+    i32 firstSpan;
+    i32 spanCount;
+};
+
+struct SearchChunkSlot
+{
+    Array<SearchResult> results;
+    bool done = false;
+};
+
+/**
+ *  SearchJob
+ *  - one search request split in chunks, shared between the search thread and the workers
+ *  - only the search ranges are read, they are cut in spans of at most SEARCH_CHUNK_SIZE (the whole file is one range)
+ *  - workers claim chunks in order and can run at most SEARCH_CHUNK_RING_SIZE chunks ahead of the merge
+ *  - the search thread merges the chunk results back in offset order
+ *  - workers sleep on workCond, the search thread on mergeCond, the state is guarded by mutex
+ *    (slot results are only touched by the worker that claimed the chunk until it is done)
+ */
+struct SearchJob
+{
+    SDL_mutex* mutex = nullptr;
+    SDL_cond* workCond = nullptr;
+    SDL_cond* mergeCond = nullptr;
+
+    bool active = false;
+    i32 activeWorkers = 0;
+    i64 nextChunk = 0;
+    i64 mergedChunk = 0;
+
+    u32 generation;
+    const FileSource* source;
+    SearchMethod::Enum method;
+    SearchNeedle needle;
+    SearchAutomaton automaton;
+    SearchRegex regex;
+    SearchNumeric numeric;
+    SearchRelative relative;
+    SearchApprox approx;
+    i32 minLen; // match lengths
+    i32 maxLen;
+    bool overlapping; // keep overlapping matches (pattern sets)
+    i64 stride;
+    i64 fileSize;
+    Array<SearchRange> ranges; // sorted, clipped to the file, a match fits in one
+    Array<SearchSpan> spans;
+    Array<SearchChunk> chunks;
+    i64 chunkCount;
+
+    SearchChunkSlot slots[SEARCH_CHUNK_RING_SIZE];
 };
 
+/**
+ *  SearchWorker
+ *  - per worker thread state, the regex DFA caches are rebuilt for each new job
+ */
+struct SearchWorker
+{
+    GrowableBuffer chunkBuff;
+    SearchRegexDfa regexScan;     // unanchored, finds where the first match ends
+    SearchRegexDfa regexAnchored; // finds the longest match from a start
+    u32 regexGeneration = 0;
+    bool regexReady = false;
+};
+
+// results written to the stream file at once
+#define SEARCH_STREAM_BATCH (64 * 1024)
+
+// SearchOutput::Binary result
+struct SearchStreamRecord
+{
+    i64 offset;
+    i32 len;
+    i32 patternId;
+};
+
+/**
+ *  SearchSink
+ *  - receives the merged results of a run, in offset order
+ *  - List pushes them to the result list, Count only counts them,
+ *    Stream fills a batch (allocated once) and writes it to the file when full
+ */
+struct SearchSink
+{
+    SearchOutput::Kind kind;
+    SearchOutput::Format format;
+    SearchResultList* list;
+    FILE* file = nullptr;
+    bool failed = false; // the stream file could not be written
+    i64 count = 0;
+    i64 maxCount;
+    Array<SearchStreamRecord> batch;
+
+    inline void push(i64 offset, i32 patternId, i32 len) {
+        count++;
+        if(kind == SearchOutput::List) {
+            list->push(offset, patternId, len);
+        }
+        else if(kind == SearchOutput::Stream) {
+            batch.push({ offset, len, patternId });
+            if(batch.count() == SEARCH_STREAM_BATCH) {
+                flush();
+            }
+        }
+    }
+
+    inline bool isFull() const {
+        return count >= maxCount;
+    }
+
+    void flush();
+};
+
+void SearchSink::flush()
+{
+    if(file && !failed) {
+        if(format == SearchOutput::Csv) {
+            for(const SearchStreamRecord& r: batch) {
+                failed |= fprintf(file, "%lld,%d,%d\n", r.offset, r.len, r.patternId) < 0;
+            }
+        }
+        else {
+            failed |= fwrite(batch.data(), sizeof(SearchStreamRecord), batch.count(), file) != (size_t)batch.count();
+        }
+    }
+    batch.clear();
+}
+
 static SDL_Thread* g_searchThread;
 static SearchQueue* g_searchQueue;
+static SearchJob* g_searchJob;
+static SDL_Thread* g_workerThreads[SEARCH_MAX_WORKERS];
+static i32 g_workerCount;
 
-static i32 thread_search(void* ptr)
+static inline bool searchIsCancelled(const SearchQueue& sq, const SearchJob& job)
 {
-    LOG("Search> thread started.");
-    SearchQueue& sq = *g_searchQueue;
+    return sq.generation.load(std::memory_order_relaxed) != job.generation;
+}
 
-    while(sq.running) {
-        if(sq.searchHashRequest == 0) {
-            SDL_Delay(1);
+// Stops the current search, if any
+static void searchCancel(SearchQueue& sq)
+{
+    sq.generation.fetch_add(1);
+
+    // the search thread may be waiting on a chunk, wake it up so it notices
+    SearchJob& job = *g_searchJob;
+    SDL_LockMutex(job.mutex);
+    SDL_CondBroadcast(job.mergeCond);
+    SDL_UnlockMutex(job.mutex);
+}
+
+// The searchXxxNext functions return the first match at or after from (on the stride) starting before end,
+// -1 if there is none. data holds the file bytes [dataStart, needed).
+
+static i64 searchNeedleNext(SearchQueue& sq, SearchJob& job, const u8* data, i64 dataStart, i64 from, i64 end,
+                            i64 needed)
+{
+    const i64 cmpDataSize = job.needle.len;
+    const i64 stride = job.stride;
+    i64 i = from;
+
+    while(true) {
+        // slices start on the stride, the kernel only reports positions on it
+        i = (i + stride - 1) / stride * stride;
+        if(i >= end || searchIsCancelled(sq, job)) {
+            break;
         }
-        else {
-            LOG("Search> new request, hash=%x", sq.searchHashRequest);
-            sq.searchHashCurrent = sq.searchHashRequest;
-			sq.resultListCurrent = sq.resultListRequest;
-            sq.paramsCurrent = sq.paramsRequest;
-
-            const i64 fileSize = sq.fileBuff.size;
-            const u8* fileData = sq.fileBuff.data;
-            const i32 cmpDataSize = sq.paramsCurrent.dataSize;
-            const i32 strideEq[] = { 1, cmpDataSize/2, cmpDataSize };
-            const i64 stride = strideEq[sq.paramsCurrent.strideKind];
-            u8 cmpData[64];
-            assert(cmpDataSize > 0);
-            assert(cmpDataSize < 64);
-
-            switch(sq.paramsCurrent.dataType) {
-                case SearchDataType::ASCII_String: {
-                    memmove(cmpData, sq.paramsCurrent.str, cmpDataSize);
-                } break;
-
-                case SearchDataType::Integer: {
-                    if(sq.paramsCurrent.intSigned) {
-                        memmove(cmpData, &sq.paramsCurrent.vint, cmpDataSize);
-                    }
-                    else{
-                        memmove(cmpData, &sq.paramsCurrent.vuint, cmpDataSize);
-                    }
-                } break;
-
-                case SearchDataType::Float: {
-                    if(cmpDataSize == 4) {
-                        memmove(cmpData, &sq.paramsCurrent.vf32, 4);
-                    }
-                    else {
-                        memmove(cmpData, &sq.paramsCurrent.vf64, 8);
-                    }
-                } break;
-
-                default: assert(0); break;
-            }
-
-            i64 foundCount = 0;
-            for(i64 i = 0; i < fileSize; i += stride) {
-                if(sq.searchHashRequest != sq.searchHashCurrent) {
-                    break; // cancel we have a new request
+
+        const i64 sliceEnd = MIN(needed, i + SEARCH_SLICE_SIZE + cmpDataSize - 1);
+        const i64 found = searchFindStride(job.needle, data + (i - dataStart), sliceEnd - i, stride);
+        if(found >= 0) {
+            const i64 offset = i + found;
+            return offset < end ? offset : -1;
+        }
+        i = sliceEnd - cmpDataSize + 1;
+    }
+    return -1;
+}
+
+static void searchChunkAutomaton(SearchQueue& sq, SearchJob& job, const u8* chunk, i64 chunkStart, i64 chunkEnd,
+                                 i64 chunkNeeded, SearchChunkSlot* slot)
+{
+    const SearchAutomaton& ac = job.automaton;
+    const i32* transitions = ac.transitions.data();
+    const i64 len = chunkNeeded - chunkStart;
+    i32 state = 0;
+
+    // matches are reported at their end, only keep the ones starting in this chunk
+    for(i64 sliceStart = 0; sliceStart < len && !searchIsCancelled(sq, job); sliceStart += SEARCH_SLICE_SIZE) {
+        const i64 sliceEnd = MIN(len, sliceStart + SEARCH_SLICE_SIZE);
+
+        for(i64 p = sliceStart; p < sliceEnd; p++) {
+            state = transitions[state * 256 + chunk[p]];
+            if(!ac.hasOutput(state)) {
+                continue;
+            }
+
+            for(i32 o = ac.outStart[state]; o < ac.outStart[state + 1]; o++) {
+                const i32 patternId = ac.outPatterns[o];
+                const i64 offset = chunkStart + p - ac.patternLens[patternId] + 1;
+                if(offset >= chunkEnd) {
+                    continue;
                 }
-				if(foundCount >= 10000000) {
-					break; // cap at 10 millions
-				}
-                // check if found
-                if(memcmp(fileData + i, cmpData, cmpDataSize) == 0) {
-                    SearchResult r;
-                    r.offset = i;
-                    r.len = cmpDataSize;
-                    sq.resultListCurrent->push(r);
-                    foundCount++;
-                    i += cmpDataSize-stride;
+
+                SearchResult r;
+                r.offset = offset;
+                r.len = ac.patternLens[patternId];
+                r.patternId = patternId;
+                slot->results.push(r);
+            }
+        }
+    }
+
+    // a long pattern ending after a short one can start before it
+    std::sort(slot->results.begin(), slot->results.end(), [](const SearchResult& a, const SearchResult& b) {
+        return a.offset < b.offset || (a.offset == b.offset && a.patternId < b.patternId);
+    });
+}
+
+static i64 searchNumericNext(SearchQueue& sq, SearchJob& job, const u8* data, i64 dataStart, i64 from, i64 end,
+                             i64 needed)
+{
+    const i64 size = job.numeric.size;
+    i64 i = from;
+    assert(i % job.stride == 0);
+
+    while(i < end && !searchIsCancelled(sq, job)) {
+        // slices start on the stride, like the chunks
+        const i64 sliceEnd = MIN(end, i + SEARCH_SLICE_SIZE);
+        const i64 found = searchNumericFind(job.numeric, data + (i - dataStart), MIN(needed, sliceEnd + size - 1) - i,
+                                            job.stride);
+        if(found >= 0) {
+            return i + found;
+        }
+        i = sliceEnd;
+    }
+    return -1;
+}
+
+static i64 searchRelativeNext(SearchQueue& sq, SearchJob& job, const u8* data, i64 dataStart, i64 from, i64 end,
+                              i64 needed)
+{
+    const i64 len = job.relative.len;
+    i64 i = from;
+    assert(i % job.stride == 0);
+
+    while(i < end && !searchIsCancelled(sq, job)) {
+        const i64 sliceEnd = MIN(end, i + SEARCH_SLICE_SIZE);
+        const i64 found = searchRelativeFind(job.relative, data + (i - dataStart), MIN(needed, sliceEnd + len - 1) - i,
+                                             job.stride);
+        if(found >= 0) {
+            return i + found;
+        }
+        i = sliceEnd;
+    }
+    return -1;
+}
+
+static i64 searchApproxNext(SearchQueue& sq, SearchJob& job, const u8* data, i64 dataStart, i64 from, i64 end,
+                            i64 needed, i32* matchLen)
+{
+    i64 i = from;
+
+    while(i < end && !searchIsCancelled(sq, job)) {
+        // the bit-parallel state restarts at each slice, this only drops matches starting before the slice
+        const i64 sliceEnd = MIN(end, i + SEARCH_SLICE_SIZE);
+        const i64 found = searchApproxFind(job.approx, data + (i - dataStart),
+                                           MIN(needed, sliceEnd + job.maxLen - 1) - i, sliceEnd - i, matchLen);
+        if(found >= 0) {
+            return i + found;
+        }
+        i = sliceEnd;
+    }
+    return -1;
+}
+
+// Length of the longest match at the start of data, 0 if there is none
+static i64 searchRegexLongest(SearchRegexDfa* dfa, const u8* data, i64 len)
+{
+    i32 state = dfa->startState();
+    i64 matchLen = 0;
+    for(i64 p = 0; p < len; p++) {
+        state = dfa->step(state, data[p]);
+        if(state == SearchRegexDfa::DEAD_STATE) {
+            break;
+        }
+        if(dfa->isMatch(state)) {
+            matchLen = p + 1;
+        }
+    }
+    return matchLen;
+}
+
+// Returns the leftmost longest match like the other searchXxxNext functions, *matchLen is its length
+static i64 searchRegexNext(SearchQueue& sq, SearchJob& job, SearchWorker* worker, const u8* data, i64 dataStart,
+                           i64 from, i64 end, i64 needed, i32* matchLen)
+{
+    const SearchRegex& regex = job.regex;
+    SearchRegexDfa& scan = worker->regexScan;
+    i64 nextCancelCheck = from + SEARCH_SLICE_SIZE;
+    i32 state = scan.startState();
+
+    // one pass of the unanchored DFA finds where the first match ends, the leftmost longest match is then
+    // resolved with the anchored DFA. It starts at most maxLen bytes before.
+    for(i64 p = from; p < needed; p++) {
+        if(p >= nextCancelCheck) {
+            if(searchIsCancelled(sq, job)) {
+                return -1;
+            }
+            nextCancelCheck += SEARCH_SLICE_SIZE;
+        }
+
+        state = scan.step(state, data[p - dataStart]);
+        if(!scan.isMatch(state)) {
+            continue;
+        }
+
+        for(i64 s = MAX(from, p + 1 - regex.maxLen); s <= p; s++) {
+            if(!regex.firstBytes.has(data[s - dataStart])) {
+                continue;
+            }
+            const i64 len = searchRegexLongest(&worker->regexAnchored, data + (s - dataStart),
+                                               MIN(needed, s + regex.maxLen) - s);
+            if(len > 0) {
+                if(s >= end) {
+                    return -1;
                 }
+                *matchLen = (i32)len;
+                return s;
+            }
+        }
+        // only matches longer than maxLen end here
+    }
+    return -1;
+}
+
+// The DFA caches point into the job regex, rebuild them for a new job
+static void searchWorkerPrepareRegex(SearchWorker* worker, const SearchJob& job)
+{
+    if(!worker->regexReady || worker->regexGeneration != job.generation) {
+        worker->regexScan.init(&job.regex, false);
+        worker->regexAnchored.init(&job.regex, true);
+        worker->regexGeneration = job.generation;
+        worker->regexReady = true;
+    }
+}
+
+// Next non-overlapping match of the job, see searchNeedleNext
+static bool searchNextMatch(SearchQueue& sq, SearchJob& job, SearchWorker* worker, const u8* data, i64 dataStart,
+                            i64 from, i64 end, i64 needed, SearchResult* match)
+{
+    i64 offset = -1;
+    i32 len = job.minLen;
+
+    switch(job.method) {
+        case SearchMethod::NEEDLE: {
+            offset = searchNeedleNext(sq, job, data, dataStart, from, end, needed);
+        } break;
+
+        case SearchMethod::NUMERIC: {
+            offset = searchNumericNext(sq, job, data, dataStart, from, end, needed);
+        } break;
+
+        case SearchMethod::RELATIVE: {
+            offset = searchRelativeNext(sq, job, data, dataStart, from, end, needed);
+        } break;
+
+        case SearchMethod::APPROX: {
+            offset = searchApproxNext(sq, job, data, dataStart, from, end, needed, &len);
+        } break;
+
+        case SearchMethod::REGEX: {
+            searchWorkerPrepareRegex(worker, job);
+            offset = searchRegexNext(sq, job, worker, data, dataStart, from, end, needed, &len);
+        } break;
+
+        default: assert(0); break;
+    }
+
+    if(offset < 0) {
+        return false;
+    }
+    match->offset = offset;
+    match->len = len;
+    match->patternId = 0;
+    return true;
+}
+
+static void searchChunk(SearchQueue& sq, SearchJob& job, i64 chunkId, SearchWorker* worker)
+{
+    SearchChunkSlot& slot = job.slots[chunkId % SEARCH_CHUNK_RING_SIZE];
+    slot.results.clear();
+
+    const FileSource* source = job.source;
+    const SearchChunk& chunk = job.chunks[chunkId];
+
+    for(i32 s = chunk.firstSpan; s < chunk.firstSpan + chunk.spanCount; s++) {
+        const SearchSpan& span = job.spans[s];
+
+        // the file may still be loading in the background, wait for this span
+        while(source->available() < span.needed && source->isLoading() && !searchIsCancelled(sq, job)) {
+            SDL_Delay(1);
+        }
+
+        if(source->available() < span.needed) {
+            return; // cancelled or the load failed
+        }
+
+        const u8* data = source->fetch(span.start, span.needed - span.start, worker->chunkBuff.data,
+                                       FileReadHint::STREAM);
+        if(!data) {
+            return; // read failed
+        }
+
+        if(job.method == SearchMethod::AUTOMATON) {
+            searchChunkAutomaton(sq, job, data, span.start, span.end, span.needed, &slot);
+            continue;
+        }
+
+        // non-overlapping matches, one after the other
+        i64 pos = span.start;
+        SearchResult r;
+        while(slot.results.count() < SEARCH_MAX_RESULTS &&
+              searchNextMatch(sq, job, worker, data, span.start, pos, span.end, span.needed, &r)) {
+            slot.results.push(r);
+            pos = r.offset + r.len;
+        }
+    }
+}
+
+static i32 thread_searchWorker(void* ptr)
+{
+    SearchQueue& sq = *g_searchQueue;
+    SearchJob& job = *g_searchJob;
+    SearchWorker worker;
+    // chunks are read with the longest possible match past their end
+    worker.chunkBuff.init(SEARCH_CHUNK_SIZE + SEARCH_REGEX_MAX_MATCH_LEN);
+
+    SDL_LockMutex(job.mutex);
+
+    while(true) {
+        // sleep until there is a chunk to claim
+        while(sq.running && !(job.active && job.nextChunk < job.chunkCount &&
+                              job.nextChunk < job.mergedChunk + SEARCH_CHUNK_RING_SIZE)) {
+            SDL_CondWait(job.workCond, job.mutex);
+        }
+        if(!sq.running) {
+            break;
+        }
+
+        const i64 chunkId = job.nextChunk++;
+        job.activeWorkers++;
+        SDL_UnlockMutex(job.mutex);
+
+        searchChunk(sq, job, chunkId, &worker);
+
+        SDL_LockMutex(job.mutex);
+        // always flag it done, the merge stops on cancel anyway
+        job.slots[chunkId % SEARCH_CHUNK_RING_SIZE].done = true;
+        job.activeWorkers--;
+        SDL_CondBroadcast(job.mergeCond);
+    }
+
+    SDL_UnlockMutex(job.mutex);
+    return 0;
+}
+
+// Decodes one UTF-8 code point, invalid bytes are taken as is
+static u32 utf8Next(const u8** cur)
+{
+    const u8* c = *cur;
+    i32 extra = 0;
+    u32 cp = c[0];
+    if(cp >= 0xF0 && cp < 0xF8) { extra = 3; cp &= 0x07; }
+    else if(cp >= 0xE0) { extra = 2; cp &= 0x0F; }
+    else if(cp >= 0xC0) { extra = 1; cp &= 0x1F; }
+
+    for(i32 i = 1; i <= extra; i++) {
+        if((c[i] & 0xC0) != 0x80) {
+            *cur = c + 1;
+            return c[0];
+        }
+        cp = (cp << 6) | (c[i] & 0x3F);
+    }
+    *cur = c + 1 + extra;
+    return cp;
+}
+
+static inline bool isAsciiLetter(u32 c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+i32 searchEncodeString(const SearchParams& params, u8* data, u8* mask, i32 maxLen)
+{
+    // bit 5 is the ASCII case bit
+    const u8 letterMask = params.caseInsensitive ? 0xDF : 0xFF;
+    const u8* cur = (const u8*)params.str;
+    i32 len = 0;
+
+    if(params.encoding == SearchParams::Utf8) {
+        for(; *cur; cur++) {
+            if(len >= maxLen) return 0;
+            data[len] = *cur;
+            mask[len] = isAsciiLetter(*cur) ? letterMask : 0xFF;
+            len++;
+        }
+        return len;
+    }
+
+    const bool bigEndian = params.encoding == SearchParams::Utf16BE;
+    while(*cur) {
+        const u32 cp = utf8Next(&cur);
+        u16 units[2];
+        i32 unitCount = 1;
+        units[0] = (u16)cp;
+        if(cp > 0xFFFF) {
+            units[0] = (u16)(0xD800 + ((cp - 0x10000) >> 10));
+            units[1] = (u16)(0xDC00 + ((cp - 0x10000) & 0x3FF));
+            unitCount = 2;
+        }
+
+        for(i32 u = 0; u < unitCount; u++) {
+            if(len + 2 > maxLen) return 0;
+            const u8 lo = units[u] & 0xFF;
+            const u8 hi = units[u] >> 8;
+            const i32 loPos = bigEndian ? len + 1 : len;
+            const i32 hiPos = bigEndian ? len : len + 1;
+            data[loPos] = lo;
+            mask[loPos] = isAsciiLetter(units[u]) ? letterMask : 0xFF;
+            data[hiPos] = hi;
+            mask[hiPos] = 0xFF;
+            len += 2;
+        }
+    }
+    return len;
+}
+
+// Fills cmpData with the bytes to look for and cmpMask with the bits that must match, returns the byte count
+static i32 searchParamsToBytes(const SearchParams& params, u8* cmpData, u8* cmpMask)
+{
+    if(params.dataType == SearchDataType::ASCII_String) {
+        return searchEncodeString(params, cmpData, cmpMask, SEARCH_NEEDLE_MAX_LEN);
+    }
+
+    const i32 cmpDataSize = params.dataSize;
+    assert(cmpDataSize > 0);
+    assert(cmpDataSize <= 8);
+
+    switch(params.dataType) {
+        case SearchDataType::Integer: {
+            if(params.intSigned) {
+                memmove(cmpData, &params.vint, cmpDataSize);
+            }
+            else{
+                memmove(cmpData, &params.vuint, cmpDataSize);
+            }
+        } break;
+
+        case SearchDataType::Float: {
+            if(cmpDataSize == 4) {
+                memmove(cmpData, &params.vf32, 4);
+            }
+            else {
+                memmove(cmpData, &params.vf64, 8);
+            }
+        } break;
+
+        default: assert(0); break;
+    }
+
+    if(params.bigEndian) {
+        for(i32 i = 0; i < cmpDataSize / 2; i++) {
+            const u8 tmp = cmpData[i];
+            cmpData[i] = cmpData[cmpDataSize - 1 - i];
+            cmpData[cmpDataSize - 1 - i] = tmp;
+        }
+    }
+    memset(cmpMask, 0xFF, cmpDataSize);
+    return cmpDataSize;
+}
+
+static bool searchParamsIsNumeric(const SearchParams& params)
+{
+    return (params.dataType == SearchDataType::Integer || params.dataType == SearchDataType::Float) &&
+           params.compare != SearchParams::Equal;
+}
+
+// Integer / Float predicates, returns false if nothing can match
+static bool searchParamsToNumeric(const SearchParams& params, SearchNumeric* num)
+{
+    const i32 size = params.dataSize;
+
+    if(params.dataType == SearchDataType::Integer) {
+        assert(params.compare == SearchParams::Range);
+        if(params.intSigned) {
+            return searchNumericInitIntRange(num, size, params.vintMin, params.vintMax);
+        }
+        return searchNumericInitUintRange(num, size, params.vuintMin, params.vuintMax);
+    }
+
+    assert(params.dataType == SearchDataType::Float);
+    const f64 value = size == 4 ? params.vf32 : params.vf64;
+
+    switch(params.compare) {
+        case SearchParams::Range: return searchNumericInitFloatRange(num, size, params.vfMin, params.vfMax);
+        case SearchParams::Tolerance: return searchNumericInitFloatTolerance(num, size, value, params.vfEps);
+        case SearchParams::Ulp: return searchNumericInitFloatUlp(num, size, value, params.ulps);
+        case SearchParams::NonFinite: {
+            searchNumericInitNonFinite(num, size);
+            return true;
+        }
+        default: assert(0); break;
+    }
+    return false;
+}
+
+// Approximate pattern, returns false if it doesn't parse
+static bool searchParamsToApprox(const SearchParams& params, SearchApprox* approx)
+{
+    SearchPattern pattern;
+    if(searchParsePatterns(params.approxPattern, &pattern, 1) == 0) {
+        pattern.len = 0;
+    }
+    return searchApproxInit(approx, pattern.data, pattern.len, params.approxMaxErrors, params.approxEdits);
+}
+
+// Stride of needle and numeric searches
+static i64 searchParamsStride(const SearchParams& params, i32 size)
+{
+    const i32 strideEq[] = { 1, size/2, size };
+    return MAX(1, strideEq[params.strideKind]); // 8bit ints have no half stride
+}
+
+// Queries searched with a needle, returns its length (0 for other queries)
+static i32 searchParamsToNeedle(const SearchParams& params, u8* data, u8* mask)
+{
+    switch(params.dataType) {
+        case SearchDataType::Masked_Pattern: {
+            return searchParseMaskedPattern(params.maskedPattern, data, mask, SEARCH_NEEDLE_MAX_LEN);
+        }
+
+        case SearchDataType::ASCII_String:
+        case SearchDataType::Integer:
+        case SearchDataType::Float: {
+            if(searchParamsIsNumeric(params) || params.dataSize == 0) {
+                return 0;
+            }
+            return searchParamsToBytes(params, data, mask);
+        }
+
+        default: break;
+    }
+    return 0;
+}
+
+// Two matches of the needle can't overlap, the results are then every occurrence
+static bool searchNeedleIsDisjoint(const u8* data, const u8* mask, i32 len)
+{
+    for(i32 shift = 1; shift < len; shift++) {
+        i32 i = 0;
+        for(; i < len - shift; i++) {
+            if((data[i] ^ data[i + shift]) & mask[i] & mask[i + shift]) break;
+        }
+        if(i == len - shift) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Every match of next is also a match of prev at the same offset. The results of prev can then be filtered
+// instead of searching the whole file again (a longer string, a narrower range...)
+static bool searchParamsNarrows(const SearchParams& prev, const SearchParams& next)
+{
+    if(prev.dataType != next.dataType) {
+        return false;
+    }
+
+    switch(next.dataType) {
+        case SearchDataType::Multi_Pattern:
+        case SearchDataType::Regex: {
+            return false;
+        }
+
+        case SearchDataType::Relative: {
+            const i32 prevLen = (i32)strlen(prev.relativeWord);
+            const i64 prevStride = prev.strideKind == SearchParams::Even ? prev.relativeElemSize : 1;
+            const i64 nextStride = next.strideKind == SearchParams::Even ? next.relativeElemSize : 1;
+            return prevLen >= 2 && prev.relativeElemSize == next.relativeElemSize &&
+                   nextStride % prevStride == 0 &&
+                   strncmp(prev.relativeWord, next.relativeWord, prevLen) == 0;
+        }
+
+        case SearchDataType::Approximate: {
+            // Hamming only, edit distance matches are picked by where they end
+            if(prev.approxEdits || next.approxEdits) {
+                return false;
+            }
+            SearchApprox prevApprox;
+            SearchApprox nextApprox;
+            if(!searchParamsToApprox(prev, &prevApprox) || !searchParamsToApprox(next, &nextApprox)) {
+                return false;
+            }
+            return nextApprox.len >= prevApprox.len && nextApprox.maxErrors <= prevApprox.maxErrors &&
+                   memcmp(prevApprox.pattern, nextApprox.pattern, prevApprox.len) == 0;
+        }
+
+        default: break;
+    }
+
+    if(searchParamsIsNumeric(prev) || searchParamsIsNumeric(next)) {
+        if(!searchParamsIsNumeric(prev) || !searchParamsIsNumeric(next) ||
+           prev.dataSize != next.dataSize || prev.compare != next.compare || prev.bigEndian != next.bigEndian ||
+           searchParamsStride(next, next.dataSize) % searchParamsStride(prev, prev.dataSize) != 0) {
+            return false;
+        }
+
+        if(next.dataType == SearchDataType::Integer) {
+            if(prev.intSigned != next.intSigned) {
+                return false;
+            }
+            if(next.intSigned) {
+                return next.vintMin >= prev.vintMin && next.vintMax <= prev.vintMax;
+            }
+            return next.vuintMin >= prev.vuintMin && next.vuintMax <= prev.vuintMax;
+        }
+
+        const f64 prevValue = prev.dataSize == 4 ? prev.vf32 : prev.vf64;
+        const f64 nextValue = next.dataSize == 4 ? next.vf32 : next.vf64;
+        switch(next.compare) {
+            case SearchParams::Range: return next.vfMin >= prev.vfMin && next.vfMax <= prev.vfMax;
+            case SearchParams::Tolerance: return nextValue == prevValue && next.vfEps <= prev.vfEps;
+            case SearchParams::Ulp: return nextValue == prevValue && next.ulps <= prev.ulps;
+            case SearchParams::NonFinite: return true;
+            default: break;
+        }
+        return false;
+    }
+
+    // needles: prev has to be a prefix of next, next may only add mask bits
+    u8 prevData[SEARCH_NEEDLE_MAX_LEN];
+    u8 prevMask[SEARCH_NEEDLE_MAX_LEN];
+    u8 nextData[SEARCH_NEEDLE_MAX_LEN];
+    u8 nextMask[SEARCH_NEEDLE_MAX_LEN];
+    const i32 prevLen = searchParamsToNeedle(prev, prevData, prevMask);
+    const i32 nextLen = searchParamsToNeedle(next, nextData, nextMask);
+    if(prevLen == 0 || nextLen < prevLen ||
+       searchParamsStride(next, nextLen) % searchParamsStride(prev, prevLen) != 0) {
+        return false;
+    }
+
+    for(i32 i = 0; i < prevLen; i++) {
+        if((nextMask[i] & prevMask[i]) != prevMask[i] || ((nextData[i] ^ prevData[i]) & prevMask[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Matches of the new query are matches of the base query at the same offset: either a base result or one the
+// base result before it shadowed, so they all start inside a base result. Only those bytes are searched again.
+static i64 searchRefine(SearchQueue& sq, SearchJob& job, SearchWorker* merger, const SearchParams& baseParams,
+                        const SearchResultList& base, SearchSink* sink)
+{
+    const i64 baseCount = base.count();
+    if(baseCount == 0 || job.minLen <= 0) {
+        return 0;
+    }
+
+    u8 needleData[SEARCH_NEEDLE_MAX_LEN];
+    u8 needleMask[SEARCH_NEEDLE_MAX_LEN];
+    const i32 needleLen = searchParamsToNeedle(baseParams, needleData, needleMask);
+    const bool baseDisjoint = needleLen > 0 && searchNeedleIsDisjoint(needleData, needleMask, needleLen);
+
+    i64 foundCount = 0;
+    i64 lastMatchEnd = 0;
+    i32 range = 0;
+    SearchResultList::Cursor cursor = base.seek(0);
+
+    for(i64 b = 0; b < baseCount; b++) {
+        if(b > 0) {
+            base.next(&cursor);
+        }
+        if((b & 4095) == 0) {
+            if(searchIsCancelled(sq, job)) {
+                break;
+            }
+            sq.foundCount.store(sink->count, std::memory_order_relaxed);
+        }
+
+        // the base was searched in the same ranges
+        while(range < job.ranges.count() && job.ranges[range].end <= cursor.offset) {
+            range++;
+        }
+        if(range == job.ranges.count()) {
+            break;
+        }
+        const i64 rangeEnd = job.ranges[range].end;
+
+        const i64 windowEnd = MIN(rangeEnd - job.minLen + 1, cursor.offset + (baseDisjoint ? 1 : cursor.len));
+        i64 from = MAX(cursor.offset, lastMatchEnd);
+
+        while(true) {
+            from = (from + job.stride - 1) / job.stride * job.stride;
+            if(from >= windowEnd) {
+                break;
+            }
+
+            const i64 needed = MIN(rangeEnd, windowEnd + job.maxLen - 1);
+            const u8* data = job.source->fetch(from, needed - from, merger->chunkBuff.data, FileReadHint::STREAM);
+            SearchResult match;
+            if(!data || !searchNextMatch(sq, job, merger, data, from, from, windowEnd, needed, &match)) {
+                break;
+            }
+
+            sink->push(match.offset, match.patternId, match.len);
+            foundCount++;
+            lastMatchEnd = match.offset + match.len;
+            from = lastMatchEnd;
+        }
+    }
+    return foundCount;
+}
+
+// A match crossing into the chunk moves where the next non-overlapping match starts, search again from its
+// end until we land on a match of the chunk. Returns the chunk result to resume the merge at.
+// Matches stay inside their range so only the first span of the chunk can be affected.
+static i32 searchResync(SearchQueue& sq, SearchJob& job, SearchWorker* merger, i64 chunkId,
+                        const Array<SearchResult>& chunkResults, SearchSink* sink, i64* lastMatchEnd)
+{
+    const SearchSpan& span = job.spans[job.chunks[chunkId].firstSpan];
+    const i64 from = *lastMatchEnd;
+    const i32 resultCount = chunkResults.count();
+    if(from >= span.end) {
+        return 0; // every match of the span is shadowed
+    }
+
+    const u8* data = job.source->fetch(from, span.needed - from, merger->chunkBuff.data, FileReadHint::STREAM);
+    if(!data) {
+        return 0; // read failed, keep the chunk results
+    }
+
+    SearchResult match;
+    i32 r = 0;
+    while(!sink->isFull() &&
+          searchNextMatch(sq, job, merger, data, from, *lastMatchEnd, span.end, span.needed, &match)) {
+        while(r < resultCount && chunkResults[r].offset < match.offset) {
+            r++;
+        }
+        if(r < resultCount && chunkResults[r].offset == match.offset) {
+            return r; // same start, same matches from here on
+        }
+
+        sink->push(match.offset, 0, match.len);
+        *lastMatchEnd = match.offset + match.len;
+    }
+
+    // the rest of the span was replaced
+    while(r < resultCount && chunkResults[r].offset < span.end) {
+        r++;
+    }
+    return r;
+}
+
+// Sorted by start, overlapping ranges are merged (touching ones are not, a match stays inside one)
+static void searchSortRanges(Array<SearchRange>* ranges)
+{
+    std::sort(ranges->begin(), ranges->end(), [](const SearchRange& a, const SearchRange& b) {
+        return a.start < b.start;
+    });
+
+    i32 count = 0;
+    for(i32 i = 0; i < ranges->count(); i++) {
+        const SearchRange r = (*ranges)[i];
+        if(r.end <= r.start) {
+            continue;
+        }
+        if(count > 0 && r.start < (*ranges)[count - 1].end) {
+            (*ranges)[count - 1].end = MAX((*ranges)[count - 1].end, r.end);
+            continue;
+        }
+        (*ranges)[count++] = r;
+    }
+    ranges->resize(count);
+}
+
+// Both sorted, out gets the parts covered by both
+static void searchIntersectRanges(const Array<SearchRange>& a, const Array<SearchRange>& b, Array<SearchRange>* out)
+{
+    out->clear();
+    i32 i = 0;
+    i32 j = 0;
+    while(i < a.count() && j < b.count()) {
+        const i64 start = MAX(a[i].start, b[j].start);
+        const i64 end = MIN(a[i].end, b[j].end);
+        if(start < end) {
+            out->push({ start, end });
+        }
+        if(a[i].end < b[j].end) {
+            i++;
+        }
+        else {
+            j++;
+        }
+    }
+}
+
+// Cuts the ranges in spans and groups the spans in chunks, spans start on the stride
+static void searchJobSplit(SearchJob* job, const Array<SearchRange>& ranges)
+{
+    const i64 chunkSize = SEARCH_CHUNK_SIZE / job->stride * job->stride;
+    job->ranges.clear();
+    job->spans.clear();
+    job->chunks.clear();
+
+    i64 chunkBytes = 0;
+    for(const SearchRange& r: ranges) {
+        const SearchRange range = { MIN(r.start, job->fileSize), MIN(r.end, job->fileSize) };
+        job->ranges.push(range);
+
+        const i64 lastPos = range.end - job->minLen;
+        if(job->minLen <= 0 || lastPos < range.start) {
+            continue;
+        }
+
+        const i64 firstPos = (range.start + job->stride - 1) / job->stride * job->stride;
+        for(i64 start = firstPos; start <= lastPos; start += chunkSize) {
+            SearchSpan span;
+            span.start = start;
+            span.end = MIN(lastPos + 1, start + chunkSize);
+            span.needed = MIN(range.end, span.end + job->maxLen - 1);
+            const i64 spanBytes = span.needed - span.start;
+
+            if(job->chunks.count() == 0 || chunkBytes + spanBytes > chunkSize) {
+                job->chunks.push({ job->spans.count(), 0 });
+                chunkBytes = 0;
+            }
+            job->spans.push(span);
+            job->chunks.last().spanCount++;
+            chunkBytes += spanBytes;
+        }
+    }
+    job->chunkCount = job->chunks.count();
+}
+
+// Returns true if the search ran to completion (results are exact and not capped)
+static bool searchRun(SearchQueue& sq, SearchJob& job, SearchWorker* merger, const SearchParams& params,
+                      const Array<SearchRange>& ranges, SearchSink* sink, const FileSource* source,
+                      u32 generation, const SearchParams* baseParams, const SearchResultList* base,
+                      const SearchIndex* index)
+{
+    const i64 fileSize = source ? source->size : 0;
+    // the base results are already fewer than the index candidates
+    bool indexed = !base && index && index->isReady() && index->fileSize == fileSize;
+    Array<SearchRange> indexRanges;
+
+    // set up the job, no worker is active at this point
+    SDL_LockMutex(job.mutex);
+
+    if(params.dataType == SearchDataType::Multi_Pattern) {
+        Array<SearchPattern> patterns;
+        patterns.resize(SEARCH_PATTERN_MAX_COUNT);
+        const i32 patternCount = searchParsePatterns(params.patterns, patterns.data(), SEARCH_PATTERN_MAX_COUNT);
+
+        job.method = SearchMethod::AUTOMATON;
+        job.automaton.build(patterns.data(), patternCount);
+
+        u8 fullMask[SEARCH_PATTERN_MAX_LEN];
+        memset(fullMask, 0xFF, sizeof(fullMask));
+        for(i32 p = 0; p < patternCount && indexed; p++) {
+            indexed = index->candidates(patterns[p].data, fullMask, patterns[p].len, &indexRanges);
+        }
+        job.minLen = job.automaton.minLen;
+        job.maxLen = job.automaton.maxLen;
+        job.overlapping = true;
+        job.stride = 1;
+    }
+    else if(params.dataType == SearchDataType::Masked_Pattern) {
+        u8 data[SEARCH_NEEDLE_MAX_LEN];
+        u8 mask[SEARCH_NEEDLE_MAX_LEN];
+        const i32 len = searchParseMaskedPattern(params.maskedPattern, data, mask, SEARCH_NEEDLE_MAX_LEN);
+
+        job.method = SearchMethod::NEEDLE;
+        if(len > 0) {
+            searchNeedleInitMasked(&job.needle, data, mask, len);
+        }
+        indexed = indexed && len > 0 && index->candidates(data, mask, len, &indexRanges);
+        job.minLen = len;
+        job.maxLen = len;
+        job.overlapping = false;
+        job.stride = 1;
+    }
+    else if(params.dataType == SearchDataType::Regex) {
+        char error[128];
+        job.method = SearchMethod::REGEX;
+        if(job.regex.compile(params.regex, error, sizeof(error))) {
+            job.minLen = job.regex.minLen;
+            job.maxLen = job.regex.maxLen;
+        }
+        else {
+            LOG("Search> invalid regex: %s", error);
+            job.minLen = 0;
+            job.maxLen = 0;
+        }
+        job.overlapping = false;
+        job.stride = 1;
+    }
+    else if(params.dataType == SearchDataType::Approximate) {
+        job.method = SearchMethod::APPROX;
+        const bool valid = searchParamsToApprox(params, &job.approx);
+        job.minLen = valid ? job.approx.minLen : 0;
+        job.maxLen = valid ? job.approx.maxLen : 0;
+        job.overlapping = false;
+        job.stride = 1;
+    }
+    else if(params.dataType == SearchDataType::Relative) {
+        const i32 wordLen = MIN((i32)strlen(params.relativeWord), SEARCH_NEEDLE_MAX_LEN / 2);
+        const i32 elemSize = params.relativeElemSize == 2 ? 2 : 1;
+
+        job.method = SearchMethod::RELATIVE;
+        const bool valid = searchRelativeInit(&job.relative, (const u8*)params.relativeWord, wordLen, elemSize);
+        job.minLen = valid ? job.relative.len : 0;
+        job.maxLen = job.relative.len;
+        job.overlapping = false;
+        job.stride = params.strideKind == SearchParams::Even ? elemSize : 1;
+    }
+    else if(searchParamsIsNumeric(params)) {
+        const i32 size = params.dataSize;
+
+        job.method = SearchMethod::NUMERIC;
+        const bool valid = searchParamsToNumeric(params, &job.numeric);
+        job.numeric.bigEndian = params.bigEndian;
+        job.minLen = valid ? size : 0; // an empty range finds nothing
+        job.maxLen = size;
+        job.overlapping = false;
+        job.stride = searchParamsStride(params, size);
+    }
+    else {
+        u8 cmpData[SEARCH_NEEDLE_MAX_LEN];
+        u8 cmpMask[SEARCH_NEEDLE_MAX_LEN];
+        const i32 cmpDataSize = searchParamsToBytes(params, cmpData, cmpMask);
+
+        job.method = SearchMethod::NEEDLE;
+        if(cmpDataSize > 0) {
+            searchNeedleInitMasked(&job.needle, cmpData, cmpMask, cmpDataSize);
+        }
+        indexed = indexed && cmpDataSize > 0 && index->candidates(cmpData, cmpMask, cmpDataSize, &indexRanges);
+        job.minLen = cmpDataSize;
+        job.maxLen = cmpDataSize;
+        job.overlapping = false;
+        job.stride = searchParamsStride(params, cmpDataSize);
+    }
+
+    job.generation = generation;
+    job.source = source;
+    job.fileSize = fileSize;
+
+    if(indexed) {
+        // only scan the blocks where a match can start, the results are the same
+        Array<SearchRange> scanRanges;
+        searchSortRanges(&indexRanges);
+        searchIntersectRanges(ranges, indexRanges, &scanRanges);
+        searchJobSplit(&job, scanRanges);
+        LOG("Search> [%u] index: %d ranges to scan", generation, scanRanges.count());
+    }
+    else {
+        searchJobSplit(&job, ranges);
+    }
+
+    if(base) {
+        // single pass over the base results, no worker needed
+        SDL_UnlockMutex(job.mutex);
+        const i64 foundCount = searchRefine(sq, job, merger, *baseParams, *base, sink);
+        LOG("Search> [%u] refined %lld results, %lld found.", generation, base->count(), foundCount);
+        return !searchIsCancelled(sq, job);
+    }
+
+    job.nextChunk = 0;
+    job.mergedChunk = 0;
+    for(i32 s = 0; s < SEARCH_CHUNK_RING_SIZE; s++) {
+        job.slots[s].done = false;
+    }
+    job.active = true;
+    SDL_CondBroadcast(job.workCond);
+
+    // merge chunk results in offset order, as soon as they are done
+    i64 lastMatchEnd = 0;
+    for(i64 c = 0; c < job.chunkCount; c++) {
+        SearchChunkSlot& slot = job.slots[c % SEARCH_CHUNK_RING_SIZE];
+        while(!slot.done && !searchIsCancelled(sq, job)) {
+            SDL_CondWait(job.mergeCond, job.mutex);
+        }
+        if(searchIsCancelled(sq, job)) {
+            break;
+        }
+
+        // the slot is ours until mergedChunk moves past it
+        SDL_UnlockMutex(job.mutex);
+
+        const i32 resultCount = slot.results.count();
+        i32 r = 0;
+        if(!job.overlapping && resultCount > 0 && slot.results[0].offset < lastMatchEnd) {
+            r = searchResync(sq, job, merger, c, slot.results, sink, &lastMatchEnd);
+        }
+
+        for(; r < resultCount && !sink->isFull(); r++) {
+            const SearchResult& res = slot.results[r];
+            // a match crossing the chunk end shadows the overlapping ones of the next chunk
+            if(res.offset < lastMatchEnd && !job.overlapping) {
+                continue;
             }
+            sink->push(res.offset, res.patternId, res.len);
+            lastMatchEnd = res.offset + res.len;
+        }
+        sq.foundCount.store(sink->count, std::memory_order_relaxed);
+
+        SDL_LockMutex(job.mutex);
+        slot.done = false;
+        job.mergedChunk = c + 1;
+        SDL_CondBroadcast(job.workCond); // room in the ring
+
+        if(sink->isFull()) {
+            break; // the list is capped at a billion
+        }
+    }
+
+    // stop the workers and wait for them to let go of the job
+    job.active = false;
+    while(job.activeWorkers != 0) {
+        SDL_CondWait(job.mergeCond, job.mutex);
+    }
+    SDL_UnlockMutex(job.mutex);
+
+    LOG("Search> [%u] done, %lld found.", generation, sink->count);
+    // a file that failed to load is missing chunks
+    return !searchIsCancelled(sq, job) && !sink->isFull() &&
+           (!source || source->available() >= fileSize);
+}
+
+static i32 thread_search(void* ptr)
+{
+    LOG("Search> thread started.");
+    SearchQueue& sq = *g_searchQueue;
+    SearchJob& job = *g_searchJob;
+    SearchWorker merger; // resync after a match crossing chunks
+    merger.chunkBuff.init(SEARCH_CHUNK_SIZE + SEARCH_REGEX_MAX_MATCH_LEN);
+
+    SDL_LockMutex(sq.mutex);
+
+    while(true) {
+        while(sq.running && !sq.pending) {
+            SDL_CondWait(sq.cond, sq.mutex);
+        }
+        if(!sq.running) {
+            break;
+        }
+
+        const SearchParams params = sq.paramsRequest;
+        const Array<SearchRange> ranges = sq.rangesRequest;
+        SearchResultList* resultList = sq.resultListRequest;
+        const SearchOutput output = sq.outputRequest;
+        const FileSource* source = sq.fileSource;
+        const SearchIndex* index = sq.index;
+        const u32 generation = sq.generation.load();
+        const bool refine = sq.refineBaseValid;
+        sq.pending = false;
+        sq.busy = true;
+        SDL_UnlockMutex(sq.mutex);
 
-            LOG("Search> [%x] done, %lld found.", sq.searchHashCurrent, foundCount);
-            if(sq.searchHashRequest == sq.searchHashCurrent) {
-                sq.searchHashRequest = 0;
+        LOG("Search> new request [%u]", generation);
+        SearchSink sink;
+        sink.kind = output.kind;
+        sink.format = output.format;
+        sink.list = resultList;
+        // only the list holds memory per result
+        sink.maxCount = output.kind == SearchOutput::List ? SEARCH_MAX_RESULTS : INT64_MAX;
+        if(output.kind == SearchOutput::Stream) {
+            sink.batch.reserve(SEARCH_STREAM_BATCH);
+            sink.file = fopen(output.path, output.format == SearchOutput::Csv ? "w" : "wb");
+            if(!sink.file) {
+                LOG("ERROR: Search> can not write '%s'", output.path);
+                sink.failed = true;
             }
-            sq.searchHashCurrent = 0;
+            else if(output.format == SearchOutput::Csv) {
+                sink.failed = fputs("offset,length,pattern\n", sink.file) < 0;
+            }
+        }
+
+        bool complete = false;
+        if(!sink.failed) {
+            complete = searchRun(sq, job, &merger, params, ranges, &sink, source, generation,
+                                 refine ? &sq.refineBaseParams : nullptr, refine ? &sq.refineBase : nullptr, index);
+        }
+        if(sink.file) {
+            sink.flush();
+            sink.failed |= fclose(sink.file) != 0;
         }
+        complete = complete && !sink.failed;
+
+        SDL_LockMutex(sq.mutex);
+        sq.foundCount.store(sink.count, std::memory_order_relaxed);
+        sq.lastComplete = complete && sq.generation.load() == generation;
+        if(sq.lastComplete && output.kind == SearchOutput::List) {
+            sq.completeList = resultList;
+            sq.completeCount = resultList->count();
+            sq.completeParams = params;
+            sq.completeRanges = ranges;
+            // narrower than the base now
+            sq.refineBaseValid = false;
+            sq.refineBase.clear();
+        }
+        sq.busy = false;
+        SDL_CondBroadcast(sq.cond);
     }
+
+    SDL_UnlockMutex(sq.mutex);
     return 0;
 }
 
 bool searchStartThread()
 {
     static SearchQueue sq;
+    static SearchJob job;
+    sq.mutex = SDL_CreateMutex();
+    sq.cond = SDL_CreateCond();
+    job.mutex = SDL_CreateMutex();
+    job.workCond = SDL_CreateCond();
+    job.mergeCond = SDL_CreateCond();
     g_searchQueue = &sq;
+    g_searchJob = &job;
+    searchKernelInit();
+
+    // the search thread only merges, leave it a core
+    g_workerCount = clamp(SDL_GetCPUCount() - 1, 1, SEARCH_MAX_WORKERS);
+    for(i32 w = 0; w < g_workerCount; w++) {
+        g_workerThreads[w] = SDL_CreateThread(thread_searchWorker, "SearchWorker", nullptr);
+    }
+    LOG("Search> %d workers", g_workerCount);
+
     g_searchThread = SDL_CreateThread(thread_search, "Search", nullptr);
     return true;
 }
 
 void searchTerminateThread()
 {
-	g_searchQueue->running = false;
+	SearchQueue& sq = *g_searchQueue;
+	SearchJob& job = *g_searchJob;
+
+	SDL_LockMutex(sq.mutex);
+	sq.running = false;
+	SDL_CondBroadcast(sq.cond);
+	SDL_UnlockMutex(sq.mutex);
+	searchCancel(sq);
+
 	i32 status;
 	SDL_WaitThread(g_searchThread, &status);
+
+	SDL_LockMutex(job.mutex);
+	SDL_CondBroadcast(job.workCond);
+	SDL_UnlockMutex(job.mutex);
+	for(i32 w = 0; w < g_workerCount; w++) {
+		SDL_WaitThread(g_workerThreads[w], &status);
+	}
+
+	SDL_DestroyCond(job.mergeCond);
+	SDL_DestroyCond(job.workCond);
+	SDL_DestroyMutex(job.mutex);
+	SDL_DestroyCond(sq.cond);
+	SDL_DestroyMutex(sq.mutex);
 }
 
-void searchSetNewFileBuffer(BufferSlice nfb)
+// Cancels the current search and waits for the search thread to stop touching the file and the result list
+static void searchCancelAndWait(SearchQueue& sq)
+{
+    searchCancel(sq);
+
+    SDL_LockMutex(sq.mutex);
+    sq.pending = false;
+    while(sq.busy) {
+        SDL_CondWait(sq.cond, sq.mutex);
+    }
+    SDL_UnlockMutex(sq.mutex);
+}
+
+void searchSetNewFileSource(const FileSource* source)
 {
     SearchQueue& sq = *g_searchQueue;
-    sq.searchHashCurrent = 0;
-    sq.searchHashRequest = 0;
-    sq.fileBuff = nfb;
+
+    // the old buffer may be unmapped right after
+    searchCancelAndWait(sq);
+
+    SDL_LockMutex(sq.mutex);
+    sq.fileSource = source;
+    sq.completeList = nullptr;
+    sq.refineBaseValid = false;
+    sq.refineBase.clear();
+    SDL_UnlockMutex(sq.mutex);
 }
 
-void searchNewRequest(const SearchParams& params, ArrayTS<SearchResult>* results)
+void searchSetIndex(const SearchIndex* index)
 {
     SearchQueue& sq = *g_searchQueue;
+    searchCancelAndWait(sq);
+
+    SDL_LockMutex(sq.mutex);
+    sq.index = index;
+    SDL_UnlockMutex(sq.mutex);
+}
+
+static bool searchRangesEqual(const Array<SearchRange>& a, const Array<SearchRange>& b)
+{
+    if(a.count() != b.count()) {
+        return false;
+    }
+    for(i32 i = 0; i < a.count(); i++) {
+        if(a[i].start != b[i].start || a[i].end != b[i].end) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void searchNewRequest(const SearchParams& params, SearchResultList* results, const Array<SearchRange>* ranges,
+                      const SearchOutput* output)
+{
+    SearchQueue& sq = *g_searchQueue;
+
+    // the previous search may still be pushing into results
+    searchCancelAndWait(sq);
+
+    Array<SearchRange> sortedRanges;
+    if(ranges) {
+        sortedRanges = *ranges;
+        searchSortRanges(&sortedRanges);
+    }
+    else {
+        sortedRanges.push({ 0, INT64_MAX }); // clipped to the file
+    }
+
+    // narrower than the last complete search: keep its results as the base to filter
+    SDL_LockMutex(sq.mutex);
+    if(sq.completeList == results && results->count() == sq.completeCount &&
+       searchRangesEqual(sq.completeRanges, sortedRanges) &&
+       searchParamsNarrows(sq.completeParams, params)) {
+        results->swap(&sq.refineBase);
+        sq.refineBaseParams = sq.completeParams;
+        sq.refineBaseRanges = sq.completeRanges;
+        sq.refineBaseList = results;
+        sq.refineBaseValid = true;
+    }
+    else if(sq.refineBaseValid &&
+            !(sq.refineBaseList == results && searchRangesEqual(sq.refineBaseRanges, sortedRanges) &&
+              searchParamsNarrows(sq.refineBaseParams, params))) {
+        sq.refineBaseValid = false;
+        sq.refineBase.clear();
+    }
+    sq.completeList = nullptr;
+    SDL_UnlockMutex(sq.mutex);
+
+    if(params.dataType == SearchDataType::Multi_Pattern) {
+        Array<SearchPattern> patterns;
+        patterns.resize(SEARCH_PATTERN_MAX_COUNT);
+        const i32 patternCount = searchParsePatterns(params.patterns, patterns.data(), SEARCH_PATTERN_MAX_COUNT);
+
+        i32 patternLens[SEARCH_PATTERN_MAX_COUNT];
+        for(i32 p = 0; p < patternCount; p++) {
+            patternLens[p] = patterns[p].len;
+        }
+        results->resetMultiPattern(patternLens, patternCount);
+    }
+    else if(params.dataType == SearchDataType::Regex) {
+        SearchRegex regex;
+        char error[128];
+        regex.compile(params.regex, error, sizeof(error));
+        results->reset(params.dataType, MAX(regex.maxLen, 1));
+    }
+    else if(params.dataType == SearchDataType::Approximate) {
+        SearchApprox approx;
+        searchParamsToApprox(params, &approx);
+        results->reset(params.dataType, MAX(approx.maxLen, 1));
+    }
+    else {
+        results->reset(params.dataType, params.dataSize);
+    }
+
+    SDL_LockMutex(sq.mutex);
     sq.paramsRequest = params;
+    sq.rangesRequest = sortedRanges;
     sq.resultListRequest = results;
-    sq.searchHashRequest = hash32(&params, sizeof(params));
+    sq.outputRequest = output ? *output : SearchOutput();
+    sq.foundCount.store(0);
+    sq.lastComplete = false;
+    sq.generation.fetch_add(1);
+    sq.pending = true;
+    SDL_CondBroadcast(sq.cond);
+    SDL_UnlockMutex(sq.mutex);
+}
+
+i64 searchFoundCount()
+{
+    return g_searchQueue->foundCount.load(std::memory_order_relaxed);
+}
+
+bool searchWait()
+{
+    SearchQueue& sq = *g_searchQueue;
+
+    SDL_LockMutex(sq.mutex);
+    while(sq.pending || sq.busy) {
+        SDL_CondWait(sq.cond, sq.mutex);
+    }
+    const bool complete = sq.lastComplete;
+    SDL_UnlockMutex(sq.mutex);
+    return complete;
+}
+
+void SearchFinder::start(const u8* data, const u8* mask, i32 len, i64 stride_, i64 from_, bool backward_)
+{
+    searchHorspoolInit(&horspool, data, mask, len);
+    stride = MAX(stride_, 1);
+    buff.resize(SEARCH_FINDER_WINDOW + SEARCH_NEEDLE_MAX_LEN);
+    restart(from_, backward_);
+}
+
+void SearchFinder::restart(i64 from_, bool backward_)
+{
+    assert(horspool.len > 0);
+    backward = backward_;
+    from = from_; // -1 finds a match at 0 forward
+    pos = backward ? from + horspool.len - 1 : MAX(from + 1, 0); // matches starting before / after from
+    found = -1;
+    active = true;
+}
+
+bool SearchFinder::startParams(const SearchParams& params, i64 from_, bool backward_)
+{
+    u8 data[SEARCH_NEEDLE_MAX_LEN];
+    u8 mask[SEARCH_NEEDLE_MAX_LEN];
+    const i32 len = searchParamsToNeedle(params, data, mask);
+    if(len <= 0) {
+        return false;
+    }
+
+    const i64 stride_ = params.dataType == SearchDataType::Masked_Pattern ? 1 : searchParamsStride(params, len);
+    start(data, mask, len, stride_, from_, backward_);
+    return true;
+}
+
+bool SearchFinder::step(const FileSource& source, i64 budget)
+{
+    const i32 len = horspool.len;
+    const i64 fileSize = source.available();
+
+    while(active && budget > 0) {
+        // windows overlap by len-1 so a match across them is seen once
+        i64 start, end;
+        if(backward) {
+            end = MIN(pos, fileSize);
+            start = MAX(end - SEARCH_FINDER_WINDOW - (len - 1), 0);
+        }
+        else {
+            start = pos;
+            end = MIN(start + SEARCH_FINDER_WINDOW + len - 1, fileSize);
+        }
+        if(end - start < len) {
+            active = false; // reached the file boundary
+            break;
+        }
+
+        const u8* data = source.fetch(start, end - start, buff.data(), FileReadHint::STREAM);
+        if(!data) {
+            active = false; // read failed
+            break;
+        }
+        i64 hayStart = 0;
+        i64 hayEnd = end - start;
+        while(true) {
+            const i64 r = backward ? searchHorspoolFindLast(horspool, data + hayStart, hayEnd - hayStart) :
+                                     searchHorspoolFind(horspool, data + hayStart, hayEnd - hayStart);
+            if(r < 0) {
+                break;
+            }
+            const i64 offset = start + hayStart + r;
+            if(offset % stride == 0) {
+                found = offset;
+                active = false;
+                return true;
+            }
+            // off the stride, look past it
+            if(backward) {
+                hayEnd = hayStart + r + len - 1;
+            }
+            else {
+                hayStart += r + 1;
+            }
+        }
+
+        pos = backward ? start + len - 1 : end - len + 1;
+        if(backward ? start == 0 : end == fileSize) {
+            active = false;
+        }
+        budget -= end - start;
+    }
+    return !active;
 }
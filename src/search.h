@@ -1,23 +1,39 @@
 #pragma once
 #include "base.h"
 #include "utils.h"
-
-struct SearchDataType
-{
-    enum Enum: i32 {
-        ASCII_String,
-        Integer,
-        Float,
-    };
-};
+#include "search_results.h"
+#include "search_kernel.h"
 
 struct SearchParams
 {
     char str[64] = {0};
+    char patterns[4096] = {0}; // Multi_Pattern, one per line
+    char maskedPattern[256] = {0}; // Masked_Pattern, "4D 5A ?? ?? 50 45 ?0"
+    char regex[256] = {0}; // Regex, "[\x20-\x7E]{4,40}\x00"
+    char relativeWord[64] = {0}; // Relative, matched by the differences between its characters
+    char approxPattern[256] = {0}; // Approximate, hex bytes or "string"
     i64 vint;
     u64 vuint;
     f32 vf32;
-    f32 vf64;
+    f64 vf64;
+
+    // Integer / Float predicates other than Equal
+    enum Compare: i32 {
+        Equal=0,
+        Range,     // [min, max]
+        Tolerance, // |v - vf| < vfEps (floats)
+        Ulp,       // at most ulps floats away from vf (floats)
+        NonFinite, // NaN or inf (floats)
+    };
+    Compare compare = Equal;
+    i64 vintMin = 0;
+    i64 vintMax = 0;
+    u64 vuintMin = 0;
+    u64 vuintMax = 0;
+    f64 vfMin = 0;
+    f64 vfMax = 0;
+    f64 vfEps = 0.001;
+    i64 ulps = 4;
 
     u8 dataSize = 0;
     bool8 intSigned = true;
@@ -29,16 +45,112 @@ struct SearchParams
         Even
     };
     Stride strideKind = Full;
+
+    // ASCII_String
+    enum Encoding: i32 {
+        Utf8=0,
+        Utf16LE,
+        Utf16BE,
+    };
+    Encoding encoding = Utf8;
+    bool8 caseInsensitive = false; // ASCII letters only
+
+    bool8 bigEndian = false; // Integer / Float
+
+    u8 relativeElemSize = 1; // Relative, 1 or 2 (little endian)
+
+    // Approximate
+    i32 approxMaxErrors = 1;
+    bool8 approxEdits = false; // insertions and deletions count as errors too
+
+    // where to search, a match has to fit inside the selection, window or field
+    enum Scope: i32 {
+        WholeFile=0,
+        Selection,
+        Window,     // [windowStart, windowEnd)
+        BrickField, // every instance of structs[fieldStructId].bricks[fieldId] in the brick wall
+    };
+    Scope scope = WholeFile;
+    i64 windowStart = 0;
+    i64 windowEnd = 0;
+    i32 fieldStructId = -1;
+    i32 fieldId = -1;
 };
 
-struct SearchResult
+// [start, end) file offsets
+struct SearchRange
 {
-	i64 offset;
-    i32 len;
-    SearchDataType::Enum type;
+    i64 start;
+    i64 end;
+};
+
+// Where the results of a request go
+struct SearchOutput
+{
+    enum Kind: i32 {
+        List=0, // kept in the result list
+        Count,  // only counted, nothing is kept
+        Stream, // written to path in batches while merging, nothing is kept
+    };
+    enum Format: i32 {
+        Binary=0, // i64 offset, i32 length, i32 pattern id per result, little endian
+        Csv,      // "offset,length,pattern" header then one decimal line per result
+    };
+    Kind kind = List;
+    Format format = Binary;
+    char path[512] = {0};
 };
 
 bool searchStartThread();
 void searchTerminateThread();
-void searchSetNewFileBuffer(BufferSlice nfb);
-void searchNewRequest(const SearchParams& params, ArrayTS<SearchResult>* results);
+void searchSetNewFileSource(const struct FileSource* source);
+// Needle and pattern set searches only scan the blocks the index leaves, once it is ready
+void searchSetIndex(const struct SearchIndex* index);
+// Matches have to fit inside one of ranges, null searches the whole file.
+// Results only go to the list with the default output, the list is emptied otherwise.
+void searchNewRequest(const SearchParams& params, SearchResultList* results,
+                      const Array<SearchRange>* ranges = nullptr, const SearchOutput* output = nullptr);
+// Results found so far by the current or last request, whatever the output
+i64 searchFoundCount();
+// Waits for the current request, returns true if it ran to completion (not cancelled, capped or failed to write)
+bool searchWait();
+
+// Encodes params.str, mask has the bits that must match (case insensitive letters ignore bit 5).
+// Returns the byte count or 0 if longer than maxLen.
+i32 searchEncodeString(const SearchParams& params, u8* data, u8* mask, i32 maxLen);
+
+// bytes scanned by the finder per window
+#define SEARCH_FINDER_WINDOW (1024 * 1024)
+
+/**
+ *  SearchFinder
+ *  - find next / previous: the closest occurrence of a needle after or before a position, no result list
+ *  - Boyer-Moore-Horspool windows walking away from the position, stops at the first hit on the stride
+ *  - stepped by the caller with a byte budget so a far or missing match doesn't block the UI
+ */
+struct SearchFinder
+{
+    SearchHorspool horspool;
+    Array<u8> buff;
+    i64 stride = 1;
+    i64 from = 0;
+    i64 pos = 0;  // start (forward) or end (backward) of the next window
+    i64 found = -1;
+    bool backward = false;
+    bool active = false;
+
+    // Next occurrence starting after from_, or previous one starting before from_
+    void start(const u8* data, const u8* mask, i32 len, i64 stride_, i64 from_, bool backward_);
+    // Same query from another position, after a start
+    void restart(i64 from_, bool backward_);
+    // Needle of params (strings, masked patterns, integers and floats equal to a value), false for the other types
+    bool startParams(const SearchParams& params, i64 from_, bool backward_);
+    // Scans at most budget bytes, returns true once done: found is the occurrence or -1 if there is none
+    bool step(const struct FileSource& source, i64 budget);
+
+    // Part of the way to the file boundary already scanned
+    inline f32 progress(i64 fileSize) const {
+        const i64 total = backward ? from : fileSize - from;
+        return total > 0 ? (f64)(backward ? from - pos : pos - from) / total : 1.0f;
+    }
+};
@@ -0,0 +1,134 @@
+#include "search_approx.h"
+#include <string.h>
+#include <stdlib.h>
+
+bool searchApproxInit(SearchApprox* approx, const u8* pattern, i32 len, i32 maxErrors, bool edits)
+{
+    if(len <= 0 || len > SEARCH_APPROX_MAX_LEN) {
+        approx->len = 0;
+        approx->minLen = 0;
+        approx->maxLen = 0;
+        return false;
+    }
+
+    memset(approx->peq, 0, sizeof(approx->peq));
+    for(i32 i = 0; i < len; i++) {
+        approx->pattern[i] = pattern[i];
+        approx->peq[pattern[i]] |= 1ull << i;
+    }
+
+    // k >= len would match everywhere
+    approx->len = len;
+    approx->maxErrors = clamp(maxErrors, 0, MIN(len - 1, SEARCH_APPROX_MAX_ERRORS));
+    approx->edits = edits;
+    approx->minLen = edits ? len - approx->maxErrors : len;
+    approx->maxLen = edits ? len + approx->maxErrors : len;
+    return true;
+}
+
+static i64 approxFindHamming(const SearchApprox& approx, const u8* data, i64 dataLen, i64 startEnd)
+{
+    const i32 k = approx.maxErrors;
+    const u64 matchBit = 1ull << (approx.len - 1);
+    // r[j] bit i: pattern[0, i] matches the text ending here with at most j substitutions
+    u64 r[SEARCH_APPROX_MAX_ERRORS + 1] = {0};
+
+    const i64 last = MIN(dataLen, startEnd + approx.len - 1);
+    for(i64 t = 0; t < last; t++) {
+        const u64 eq = approx.peq[data[t]];
+        u64 prev = r[0];
+        r[0] = ((r[0] << 1) | 1) & eq;
+        for(i32 j = 1; j <= k; j++) {
+            const u64 cur = r[j];
+            r[j] = (((cur << 1) | 1) & eq) | ((prev << 1) | 1);
+            prev = cur;
+        }
+
+        if(r[k] & matchBit) {
+            return t + 1 - approx.len;
+        }
+    }
+    return -1;
+}
+
+// Start of the closest match ending at end, dist(pattern, data[end - t, end)) for t up to len + maxErrors.
+// Ties go to the length closest to the pattern length, then the shortest.
+static i64 approxBestStart(const SearchApprox& approx, const u8* data, i64 end, i32* matchLen)
+{
+    const i32 m = approx.len;
+    const i32 maxT = (i32)MIN(end, (i64)approx.maxLen);
+    // col[i]: distance between the last i pattern bytes and the last t data bytes
+    i32 col[SEARCH_APPROX_MAX_LEN + 1];
+    for(i32 i = 0; i <= m; i++) {
+        col[i] = i;
+    }
+
+    i32 bestDist = m + 1;
+    i32 bestT = 0;
+    for(i32 t = 1; t <= maxT; t++) {
+        const u64 eq = approx.peq[data[end - t]];
+        i32 diag = col[0];
+        col[0] = t;
+        for(i32 i = 1; i <= m; i++) {
+            const i32 up = col[i];
+            const i32 sub = diag + (i32)(((eq >> (m - i)) & 1) ^ 1);
+            col[i] = MIN(MIN(up, col[i - 1]) + 1, sub);
+            diag = up;
+        }
+
+        const i32 dist = col[m];
+        if(dist < bestDist || (dist == bestDist && abs(t - m) < abs(bestT - m))) {
+            bestDist = dist;
+            bestT = t;
+        }
+    }
+
+    assert(bestDist <= approx.maxErrors);
+    *matchLen = bestT;
+    return end - bestT;
+}
+
+static i64 approxFindEdit(const SearchApprox& approx, const u8* data, i64 dataLen, i64 startEnd, i32* matchLen)
+{
+    const u64 scoreBit = 1ull << (approx.len - 1);
+    // Myers: vertical deltas of the DP column, score is the distance of the best match ending here
+    u64 pv = ~0ull;
+    u64 mv = 0;
+    i32 score = approx.len;
+
+    const i64 last = MIN(dataLen, startEnd + approx.maxLen - 1);
+    for(i64 t = 0; t < last; t++) {
+        const u64 eq = approx.peq[data[t]];
+        const u64 xv = eq | mv;
+        const u64 xh = (((eq & pv) + pv) ^ pv) | eq;
+        u64 ph = mv | ~(xh | pv);
+        u64 mh = pv & xh;
+        if(ph & scoreBit) {
+            score++;
+        }
+        else if(mh & scoreBit) {
+            score--;
+        }
+        ph <<= 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+
+        if(score <= approx.maxErrors) {
+            // the first match to end wins, its start is resolved afterwards
+            const i64 start = approxBestStart(approx, data, t + 1, matchLen);
+            return start < startEnd ? start : -1;
+        }
+    }
+    return -1;
+}
+
+i64 searchApproxFind(const SearchApprox& approx, const u8* data, i64 dataLen, i64 startEnd, i32* matchLen)
+{
+    assert(approx.len > 0);
+    if(approx.edits) {
+        return approxFindEdit(approx, data, dataLen, startEnd, matchLen);
+    }
+    *matchLen = approx.len;
+    return approxFindHamming(approx, data, dataLen, startEnd);
+}
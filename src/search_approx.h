@@ -0,0 +1,31 @@
+#pragma once
+#include "base.h"
+#include "utils.h"
+
+#define SEARCH_APPROX_MAX_LEN 64 // one bit per pattern byte in a u64
+#define SEARCH_APPROX_MAX_ERRORS 16
+
+/**
+ *  SearchApprox
+ *  - approximate search of one pattern, at most maxErrors differences
+ *  - substitutions only (Hamming distance): Baeza-Yates / Wu-Manber shift-and, one state word per error level
+ *  - with insertions and deletions (edit distance): Myers bit-vector, then a small DP picks the start of the match
+ *  - Hamming matches are leftmost first, edit distance matches are taken in the order they end
+ */
+struct SearchApprox
+{
+    u64 peq[256]; // bit i: pattern[i] == byte
+    u8 pattern[SEARCH_APPROX_MAX_LEN];
+    i32 len = 0;
+    i32 maxErrors = 0;
+    bool edits = false;
+    i32 minLen = 0; // match lengths
+    i32 maxLen = 0;
+};
+
+// Returns false if the pattern is empty or too long, maxErrors is clamped below the pattern length
+bool searchApproxInit(SearchApprox* approx, const u8* pattern, i32 len, i32 maxErrors, bool edits);
+
+// Returns the first match of data starting before startEnd or -1, data holds dataLen bytes.
+// Only matches starting at or after data are considered.
+i64 searchApproxFind(const SearchApprox& approx, const u8* data, i64 dataLen, i64 startEnd, i32* matchLen);
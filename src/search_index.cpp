@@ -0,0 +1,297 @@
+#include "search_index.h"
+#include "search.h"
+#include <SDL_thread.h>
+#include <string.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <sys/stat.h>
+#endif
+
+#define SEARCH_INDEX_MAGIC "0xedIDX1"
+#define SEARCH_INDEX_SAMPLE_COUNT 64
+#define SEARCH_INDEX_SAMPLE_SIZE (4 * 1024)
+
+struct SearchIndexHeader
+{
+    char magic[8]; // zero until the index is complete
+    u32 blockSize;
+    u32 signatureShift;
+    i64 fileSize;
+    u64 key;
+};
+
+static inline u32 indexGramBit(const u8* data)
+{
+    u32 gram;
+    memcpy(&gram, data, sizeof(gram));
+    return (gram * 0x9E3779B1u) >> (32 - SEARCH_INDEX_SIGNATURE_SHIFT);
+}
+
+static inline u64 indexHash(u64 hash, const void* data, i64 len)
+{
+    // FNV-1a
+    for(i64 i = 0; i < len; i++) {
+        hash ^= ((const u8*)data)[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+static u64 indexFileTime(const char* path)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+    if(!GetFileAttributesExA(path, GetFileExInfoStandard, &attr)) {
+        return 0;
+    }
+    return ((u64)attr.ftLastWriteTime.dwHighDateTime << 32) | attr.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat st;
+    if(stat(path, &st) != 0) {
+        return 0;
+    }
+    return (u64)st.st_mtime;
+#endif
+}
+
+// Hashing the whole file would cost as much as building the index, only samples of it are
+static u64 indexComputeKey(const FileSource& source, const char* filePath)
+{
+    u64 hash = 0xCBF29CE484222325ull;
+    const u64 time = indexFileTime(filePath);
+    hash = indexHash(hash, &source.size, sizeof(source.size));
+    hash = indexHash(hash, &time, sizeof(time));
+
+    u8 sample[SEARCH_INDEX_SAMPLE_SIZE];
+    for(i32 s = 0; s <= SEARCH_INDEX_SAMPLE_COUNT; s++) {
+        const i64 offset = MAX(0, (source.size - SEARCH_INDEX_SAMPLE_SIZE) / SEARCH_INDEX_SAMPLE_COUNT * s);
+        const i64 len = source.read(offset, sample, SEARCH_INDEX_SAMPLE_SIZE, FileReadHint::STREAM);
+        hash = indexHash(hash, sample, len);
+    }
+    return hash;
+}
+
+bool SearchIndex::open(const FileSource* source_, const char* filePath)
+{
+    close();
+
+    // the samples of the key have to be readable
+    if(!source_->isOpen() || source_->size <= 0 || source_->available() < source_->size) {
+        return false;
+    }
+
+    source = source_;
+    fileSize = source->size;
+    snprintf(path, sizeof(path), "%s.0xed-index", filePath);
+    key = indexComputeKey(*source, filePath);
+
+    if(!_load()) {
+        return false;
+    }
+    state.store(SearchIndexState::READY, std::memory_order_release);
+    LOG("SearchIndex> loaded '%s'", path);
+    return true;
+}
+
+bool SearchIndex::_load()
+{
+    FILE* f = fopen(path, "rb");
+    if(!f) {
+        return false;
+    }
+
+    SearchIndexHeader header;
+    const bool headerRead = fread(&header, sizeof(header), 1, f) == 1;
+    fclose(f);
+
+    if(!headerRead || memcmp(header.magic, SEARCH_INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+       header.blockSize != SEARCH_INDEX_BLOCK_SIZE || header.signatureShift != SEARCH_INDEX_SIGNATURE_SHIFT ||
+       header.fileSize != fileSize || header.key != key) {
+        LOG("SearchIndex> '%s' is outdated", path);
+        return false;
+    }
+
+    const i64 count = (fileSize + SEARCH_INDEX_BLOCK_SIZE - 1) / SEARCH_INDEX_BLOCK_SIZE;
+    if(!indexFile.openMapped(path) || indexFile.size != (i64)sizeof(header) + count * SEARCH_INDEX_SIGNATURE_SIZE) {
+        indexFile.close();
+        return false;
+    }
+
+    blockCount = count;
+    signatures = indexFile.data + sizeof(header);
+    return true;
+}
+
+// Writes the block signatures in file order, the header goes last so an interrupted build is never loaded
+static i32 thread_searchIndexBuild(void* ptr)
+{
+    SearchIndex& index = *(SearchIndex*)ptr;
+    const FileSource& source = *index.source;
+    const i64 fileSize = index.fileSize;
+
+    FILE* f = fopen(index.path, "wb");
+    if(!f) {
+        LOG("ERROR: SearchIndex> can not write '%s'", index.path);
+        index.state.store(SearchIndexState::NONE, std::memory_order_release);
+        return 0;
+    }
+
+    SearchIndexHeader header = {};
+    bool written = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    // grams starting at the end of a read spill over by 3 bytes
+    Array<u8> buff;
+    buff.resize(SEARCH_INDEX_READ_SIZE + SEARCH_INDEX_GRAM_LEN - 1);
+    Array<u8> sigs;
+    sigs.resize(SEARCH_INDEX_READ_SIZE / SEARCH_INDEX_BLOCK_SIZE * SEARCH_INDEX_SIGNATURE_SIZE);
+
+    i64 offset = 0;
+    while(written && offset < fileSize && !index.buildCancel.load(std::memory_order_relaxed)) {
+        const i64 readLen = MIN(SEARCH_INDEX_READ_SIZE + SEARCH_INDEX_GRAM_LEN - 1, fileSize - offset);
+        const i64 len = MIN(SEARCH_INDEX_READ_SIZE, fileSize - offset);
+        const u8* data = source.fetch(offset, readLen, buff.data(), FileReadHint::STREAM);
+        if(!data) {
+            written = false;
+            break;
+        }
+        const i64 gramEnd = readLen - SEARCH_INDEX_GRAM_LEN + 1;
+
+        const i64 blocks = (len + SEARCH_INDEX_BLOCK_SIZE - 1) / SEARCH_INDEX_BLOCK_SIZE;
+        memset(sigs.data(), 0, blocks * SEARCH_INDEX_SIGNATURE_SIZE);
+        for(i64 b = 0; b < blocks; b++) {
+            u8* sig = sigs.data() + b * SEARCH_INDEX_SIGNATURE_SIZE;
+            const i64 end = MIN((b + 1) * SEARCH_INDEX_BLOCK_SIZE, gramEnd);
+            for(i64 i = b * SEARCH_INDEX_BLOCK_SIZE; i < end; i++) {
+                const u32 bit = indexGramBit(data + i);
+                sig[bit >> 3] |= 1 << (bit & 7);
+            }
+        }
+
+        written = fwrite(sigs.data(), SEARCH_INDEX_SIGNATURE_SIZE, blocks, f) == (size_t)blocks;
+        offset += len;
+        index.builtSize.store(offset, std::memory_order_relaxed);
+    }
+
+    if(written && offset == fileSize) {
+        memcpy(header.magic, SEARCH_INDEX_MAGIC, sizeof(header.magic));
+        header.blockSize = SEARCH_INDEX_BLOCK_SIZE;
+        header.signatureShift = SEARCH_INDEX_SIGNATURE_SHIFT;
+        header.fileSize = fileSize;
+        header.key = index.key;
+        written = fseek(f, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, f) == 1;
+    }
+    else {
+        written = false;
+    }
+    written = fclose(f) == 0 && written;
+
+    if(!written || !index._load()) {
+        if(!index.buildCancel.load()) {
+            LOG("ERROR: SearchIndex> failed to build '%s'", index.path);
+        }
+        remove(index.path);
+        index.state.store(SearchIndexState::NONE, std::memory_order_release);
+        return 0;
+    }
+
+    LOG("SearchIndex> built '%s' (%lld blocks)", index.path, index.blockCount);
+    index.state.store(SearchIndexState::READY, std::memory_order_release);
+    return 0;
+}
+
+bool SearchIndex::build()
+{
+    if(!source || state.load() != SearchIndexState::NONE) {
+        return false;
+    }
+    if(buildThread) {
+        // the last build failed, reap it
+        i32 status;
+        SDL_WaitThread(buildThread, &status);
+        buildThread = nullptr;
+    }
+
+    builtSize.store(0);
+    buildCancel.store(false);
+    state.store(SearchIndexState::BUILDING);
+    buildThread = SDL_CreateThread(thread_searchIndexBuild, "SearchIndex", this);
+    return true;
+}
+
+void SearchIndex::cancelBuild()
+{
+    if(buildThread) {
+        buildCancel.store(true);
+        i32 status;
+        SDL_WaitThread(buildThread, &status);
+        buildThread = nullptr;
+    }
+}
+
+void SearchIndex::close()
+{
+    cancelBuild();
+    state.store(SearchIndexState::NONE);
+    indexFile.close();
+    signatures = nullptr;
+    blockCount = 0;
+    source = nullptr;
+}
+
+bool SearchIndex::candidates(const u8* data, const u8* mask, i32 len, Array<SearchRange>* ranges) const
+{
+    assert(isReady());
+    assert(len < SEARCH_INDEX_BLOCK_SIZE);
+
+    // grams made of known bytes only
+    u32 bits[SEARCH_INDEX_MAX_GRAMS];
+    i32 bitCount = 0;
+    i32 known = 0;
+    for(i32 i = 0; i < len && bitCount < SEARCH_INDEX_MAX_GRAMS; i++) {
+        known = mask[i] == 0xFF ? known + 1 : 0;
+        if(known < SEARCH_INDEX_GRAM_LEN) {
+            continue;
+        }
+
+        const u32 bit = indexGramBit(data + i - SEARCH_INDEX_GRAM_LEN + 1);
+        bool dup = false;
+        for(i32 g = 0; g < bitCount; g++) {
+            dup |= bits[g] == bit;
+        }
+        if(!dup) {
+            bits[bitCount++] = bit;
+        }
+    }
+    if(bitCount == 0) {
+        return false;
+    }
+
+    const i32 firstRange = ranges->count();
+    for(i64 b = 0; b < blockCount; b++) {
+        const u8* sig = signatures + b * SEARCH_INDEX_SIGNATURE_SIZE;
+        const u8* nextSig = b + 1 < blockCount ? sig + SEARCH_INDEX_SIGNATURE_SIZE : sig;
+
+        bool possible = true;
+        for(i32 g = 0; g < bitCount && possible; g++) {
+            const u32 bit = bits[g];
+            possible = ((sig[bit >> 3] | nextSig[bit >> 3]) >> (bit & 7)) & 1;
+        }
+        if(!possible) {
+            continue;
+        }
+
+        // a match starting in the block may end in the next one
+        const i64 start = b * SEARCH_INDEX_BLOCK_SIZE;
+        const i64 end = MIN(start + SEARCH_INDEX_BLOCK_SIZE + len - 1, fileSize);
+        if(ranges->count() > firstRange && ranges->last().end > start) {
+            ranges->last().end = end;
+        }
+        else {
+            ranges->push({ start, end });
+        }
+    }
+    return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "base.h"
+#include "utils.h"
+#include "file_source.h"
+#include <atomic>
+
+#define SEARCH_INDEX_BLOCK_SIZE (32 * 1024)
+#define SEARCH_INDEX_SIGNATURE_SHIFT 15 // 32K bits per block, the index is 1/8 of the file
+#define SEARCH_INDEX_SIGNATURE_SIZE ((1 << SEARCH_INDEX_SIGNATURE_SHIFT) / 8)
+#define SEARCH_INDEX_GRAM_LEN 4
+#define SEARCH_INDEX_MAX_GRAMS 16 // probed per pattern
+#define SEARCH_INDEX_READ_SIZE (4 * 1024 * 1024)
+
+struct SearchRange;
+
+struct SearchIndexState
+{
+    enum Enum: i32 {
+        NONE = 0,
+        BUILDING,
+        READY,
+    };
+};
+
+/**
+ *  SearchIndex
+ *  - 4-gram signature of each block of the file: bit hash(gram) is set if the gram starts in the block
+ *  - a pattern can only start in a block if each of its grams is set in the block or the next one
+ *    (the grams of a match near the block end start in the next one), every other block is skipped
+ *  - exact posting lists would weigh about as much as the file, signatures have a fixed size.
+ *    Blocks of random data fill most of their bits and stay candidates, structured data gets skipped
+ *  - built on a background thread, saved next to the file (path.0xed-index) and loaded back when
+ *    its key (size, modification time and a hash of sampled blocks) still matches the file
+ *  - state is the only field shared with the build thread, the others are valid once READY
+ */
+struct SearchIndex
+{
+    std::atomic<i32> state{SearchIndexState::NONE};
+    std::atomic<i64> builtSize{0};
+    std::atomic<bool> buildCancel{false};
+    struct SDL_Thread* buildThread = nullptr;
+
+    const FileSource* source = nullptr;
+    char path[512] = {0};
+    u64 key = 0;
+    i64 fileSize = 0;
+    i64 blockCount = 0;
+    FileSource indexFile; // mapped
+    const u8* signatures = nullptr;
+
+    ~SearchIndex() { close(); }
+
+    // Loads the index saved next to filePath if it matches source, source has to stay open until close()
+    bool open(const FileSource* source_, const char* filePath);
+    // Builds the index of the opened file on a background thread, then saves and loads it
+    bool build();
+    // Waits for the build thread to stop, an unfinished index is deleted
+    void cancelBuild();
+    void close();
+
+    // Appends the ranges where a match of the pattern can be, bytes are only known where mask is 0xFF.
+    // Returns false if the pattern has no fully known gram, the index can't rule anything out then.
+    bool candidates(const u8* data, const u8* mask, i32 len, Array<SearchRange>* ranges) const;
+
+    bool _load();
+
+    inline bool isReady() const {
+        return state.load(std::memory_order_acquire) == SearchIndexState::READY;
+    }
+
+    inline bool isBuilding() const {
+        return state.load(std::memory_order_acquire) == SearchIndexState::BUILDING;
+    }
+
+    inline f32 buildProgress() const {
+        return fileSize > 0 ? (f64)builtSize.load(std::memory_order_relaxed) / fileSize : 1.0f;
+    }
+};
@@ -0,0 +1,1013 @@
+#include "search_kernel.h"
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+    #define SEARCH_TARGET_AVX2
+#else
+    #define SEARCH_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// index of the lowest set bit, mask != 0
+static inline i32 bitScanForward32(u32 mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (i32)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// only used when building a needle, no need for the popcnt instruction
+static inline i32 popCount32(u32 v)
+{
+    i32 count = 0;
+    for(; v; v &= v - 1) count++;
+    return count;
+}
+
+// rough byte frequency in typical binaries and text, higher is more common
+static i32 byteFrequency(u8 b)
+{
+    if(b == 0x00) return 255;
+    if(b == 0xFF) return 200;
+    if(b == ' ') return 190;
+    if(b >= 'a' && b <= 'z') {
+        // etaoin shrdlu
+        if(strchr("etaoinshr", b)) return 170;
+        return 140;
+    }
+    if(b < 0x10) return 150; // small ints, flags
+    if(b >= '0' && b <= '9') return 120;
+    if(b >= 'A' && b <= 'Z') return 110;
+    if(b < 0x80) return 80;
+    if(b >= 0xF0) return 70; // small negative ints
+    return 40;
+}
+
+// Rarity of a needle byte, lower is a better anchor. Wildcard bits make a byte a worse anchor.
+static i32 needleByteScore(u8 b, u8 mask)
+{
+    if(mask == 0xFF) return byteFrequency(b);
+    // case folded letter, matches 2 bytes
+    if(mask == 0xDF && b >= 'A' && b <= 'Z') return byteFrequency(b | 0x20) + 30;
+    if(mask == 0) return 1000;
+    return 512 - popCount32(mask) * 16;
+}
+
+void searchNeedleInitMasked(SearchNeedle* needle, const u8* data, const u8* mask, i32 len)
+{
+    assert(len > 0 && len <= SEARCH_NEEDLE_MAX_LEN);
+    needle->len = len;
+    needle->masked = false;
+    for(i32 i = 0; i < len; i++) {
+        needle->mask[i] = mask[i];
+        needle->data[i] = data[i] & mask[i];
+        needle->masked |= mask[i] != 0xFF;
+    }
+
+    const u8* d = needle->data;
+    const u8* m = needle->mask;
+
+    i32 rare1 = 0;
+    for(i32 i = 1; i < len; i++) {
+        if(needleByteScore(d[i], m[i]) < needleByteScore(d[rare1], m[rare1])) {
+            rare1 = i;
+        }
+    }
+
+    // second rarest byte must differ from the first one or it doesn't filter anything more
+    i32 rare2 = rare1;
+    for(i32 i = 0; i < len; i++) {
+        if(d[i] == d[rare1] && m[i] == m[rare1]) continue;
+        if(rare2 == rare1 || needleByteScore(d[i], m[i]) < needleByteScore(d[rare2], m[rare2])) {
+            rare2 = i;
+        }
+    }
+
+    needle->rare1 = rare1;
+    needle->rare2 = rare2;
+}
+
+void searchNeedleInit(SearchNeedle* needle, const u8* data, i32 len)
+{
+    u8 mask[SEARCH_NEEDLE_MAX_LEN];
+    memset(mask, 0xFF, sizeof(mask));
+    searchNeedleInitMasked(needle, data, mask, len);
+}
+
+static inline i32 hexDigitValue(char c)
+{
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// One hex digit or ?, sets the 4 value and mask bits
+static bool parseNibble(char c, u8* value, u8* mask)
+{
+    if(c == '?') {
+        *value = 0;
+        *mask = 0;
+        return true;
+    }
+    const i32 v = hexDigitValue(c);
+    if(v < 0) return false;
+    *value = v;
+    *mask = 0xF;
+    return true;
+}
+
+i32 searchParseMaskedPattern(const char* text, u8* data, u8* mask, i32 maxLen)
+{
+    const char* cur = text;
+    i32 len = 0;
+
+    while(*cur) {
+        if(*cur == ' ' || *cur == '\t') {
+            cur++;
+            continue;
+        }
+        if(len >= maxLen) return 0;
+
+        // lone ? is a whole byte
+        if(cur[0] == '?' && (cur[1] == 0 || cur[1] == ' ' || cur[1] == '\t')) {
+            data[len] = 0;
+            mask[len] = 0;
+            len++;
+            cur++;
+            continue;
+        }
+
+        u8 hi, hiMask, lo, loMask;
+        if(!parseNibble(cur[0], &hi, &hiMask) || !cur[1] || !parseNibble(cur[1], &lo, &loMask)) {
+            return 0;
+        }
+        data[len] = (hi << 4) | lo;
+        mask[len] = (hiMask << 4) | loMask;
+        cur += 2;
+
+        // explicit bit mask: 40/F0
+        if(*cur == '/') {
+            u8 m1, m2, unused;
+            if(!cur[1] || !cur[2] || !parseNibble(cur[1], &m1, &unused) || !parseNibble(cur[2], &m2, &unused) ||
+               cur[1] == '?' || cur[2] == '?') {
+                return 0;
+            }
+            mask[len] &= (m1 << 4) | m2;
+            cur += 3;
+        }
+
+        len++;
+    }
+
+    return len;
+}
+
+static inline bool needleVerify(const SearchNeedle& needle, const u8* p)
+{
+    if(!needle.masked) {
+        return memcmp(p, needle.data, needle.len) == 0;
+    }
+
+    i32 i = 0;
+    for(; i + 16 <= needle.len; i += 16) {
+        const __m128i b = _mm_loadu_si128((const __m128i*)(p + i));
+        const __m128i m = _mm_loadu_si128((const __m128i*)(needle.mask + i));
+        const __m128i d = _mm_loadu_si128((const __m128i*)(needle.data + i));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(b, m), d)) != 0xFFFF) {
+            return false;
+        }
+    }
+    for(; i < needle.len; i++) {
+        if((p[i] & needle.mask[i]) != needle.data[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static i64 searchFindScalar(const SearchNeedle& needle, const u8* hay, i64 hayLen)
+{
+    const i64 lastPos = hayLen - needle.len;
+    const u8 rareByte = needle.data[needle.rare1];
+    const u8 rareMask = needle.mask[needle.rare1];
+    i64 p = 0;
+
+    if(rareMask != 0xFF) {
+        for(; p <= lastPos; p++) {
+            if((hay[p + needle.rare1] & rareMask) == rareByte && needleVerify(needle, hay + p)) {
+                return p;
+            }
+        }
+        return -1;
+    }
+
+    // memchr is already vectorized by the CRT
+    while(p <= lastPos) {
+        const u8* f = (const u8*)memchr(hay + p + needle.rare1, rareByte, lastPos - p + 1);
+        if(!f) {
+            return -1;
+        }
+        const i64 cand = (f - hay) - needle.rare1;
+        if(needleVerify(needle, hay + cand)) {
+            return cand;
+        }
+        p = cand + 1;
+    }
+    return -1;
+}
+
+static i64 searchFindSSE2(const SearchNeedle& needle, const u8* hay, i64 hayLen)
+{
+    const i64 lastPos = hayLen - needle.len;
+    const __m128i r1 = _mm_set1_epi8((char)needle.data[needle.rare1]);
+    const __m128i r2 = _mm_set1_epi8((char)needle.data[needle.rare2]);
+    const __m128i m1 = _mm_set1_epi8((char)needle.mask[needle.rare1]);
+    const __m128i m2 = _mm_set1_epi8((char)needle.mask[needle.rare2]);
+    i64 p = 0;
+
+    for(; p + 15 <= lastPos; p += 16) {
+        const __m128i b1 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(hay + p + needle.rare1)), m1);
+        const __m128i b2 = _mm_and_si128(_mm_loadu_si128((const __m128i*)(hay + p + needle.rare2)), m2);
+        u32 mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(b1, r1), _mm_cmpeq_epi8(b2, r2)));
+
+        while(mask) {
+            const i64 cand = p + bitScanForward32(mask);
+            if(needleVerify(needle, hay + cand)) {
+                return cand;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    const i64 tail = searchFindScalar(needle, hay + p, hayLen - p);
+    return tail < 0 ? -1 : p + tail;
+}
+
+SEARCH_TARGET_AVX2
+static i64 searchFindAVX2(const SearchNeedle& needle, const u8* hay, i64 hayLen)
+{
+    const i64 lastPos = hayLen - needle.len;
+    const __m256i r1 = _mm256_set1_epi8((char)needle.data[needle.rare1]);
+    const __m256i r2 = _mm256_set1_epi8((char)needle.data[needle.rare2]);
+    const __m256i m1 = _mm256_set1_epi8((char)needle.mask[needle.rare1]);
+    const __m256i m2 = _mm256_set1_epi8((char)needle.mask[needle.rare2]);
+    i64 p = 0;
+
+    for(; p + 31 <= lastPos; p += 32) {
+        const __m256i b1 = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(hay + p + needle.rare1)), m1);
+        const __m256i b2 = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(hay + p + needle.rare2)), m2);
+        u32 mask = (u32)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(b1, r1),
+                                                              _mm256_cmpeq_epi8(b2, r2)));
+
+        while(mask) {
+            const i64 cand = p + bitScanForward32(mask);
+            if(needleVerify(needle, hay + cand)) {
+                return cand;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    const i64 tail = searchFindSSE2(needle, hay + p, hayLen - p);
+    return tail < 0 ? -1 : p + tail;
+}
+
+typedef i64 (*SearchFindFunc)(const SearchNeedle& needle, const u8* hay, i64 hayLen);
+static SearchFindFunc g_searchFind = searchFindSSE2;
+static bool g_kernelAVX2 = false;
+
+static bool cpuHasAVX2()
+{
+#ifdef _MSC_VER
+    i32 info[4];
+    __cpuid(info, 0);
+    if(info[0] < 7) return false;
+
+    // the OS must save the ymm registers too
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    if(!osxsave || (_xgetbv(0) & 6) != 6) return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+void searchKernelInit()
+{
+    if(cpuHasAVX2()) {
+        g_searchFind = searchFindAVX2;
+        g_kernelAVX2 = true;
+        LOG("Search> using AVX2 kernel");
+    }
+    else {
+        g_searchFind = searchFindSSE2;
+        g_kernelAVX2 = false;
+        LOG("Search> using SSE2 kernel");
+    }
+}
+
+i64 searchFind(const SearchNeedle& needle, const u8* hay, i64 hayLen)
+{
+    if(hayLen < needle.len) {
+        return -1;
+    }
+    return g_searchFind(needle, hay, hayLen);
+}
+
+void searchHorspoolInit(SearchHorspool* horspool, const u8* data, const u8* mask, i32 len)
+{
+    assert(len > 0 && len <= SEARCH_NEEDLE_MAX_LEN);
+    horspool->len = len;
+    for(i32 i = 0; i < len; i++) {
+        horspool->mask[i] = mask[i];
+        horspool->data[i] = data[i] & mask[i];
+    }
+
+    // shift to the closest other needle position the byte can match, the whole needle if none
+    for(i32 b = 0; b < 256; b++) {
+        horspool->shiftForward[b] = len;
+        horspool->shiftBackward[b] = len;
+    }
+    for(i32 i = 0; i < len - 1; i++) {
+        for(i32 b = 0; b < 256; b++) {
+            if((b & mask[i]) == horspool->data[i]) {
+                horspool->shiftForward[b] = len - 1 - i;
+            }
+        }
+    }
+    for(i32 i = len - 1; i > 0; i--) {
+        for(i32 b = 0; b < 256; b++) {
+            if((b & mask[i]) == horspool->data[i]) {
+                horspool->shiftBackward[b] = i;
+            }
+        }
+    }
+}
+
+static inline bool horspoolMatches(const SearchHorspool& horspool, const u8* at)
+{
+    for(i32 i = 0; i < horspool.len; i++) {
+        if((at[i] & horspool.mask[i]) != horspool.data[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+i64 searchHorspoolFind(const SearchHorspool& horspool, const u8* hay, i64 hayLen)
+{
+    const i32 last = horspool.len - 1;
+    for(i64 p = 0; p + last < hayLen; ) {
+        const u8 b = hay[p + last];
+        if((b & horspool.mask[last]) == horspool.data[last] && horspoolMatches(horspool, hay + p)) {
+            return p;
+        }
+        p += horspool.shiftForward[b];
+    }
+    return -1;
+}
+
+i64 searchHorspoolFindLast(const SearchHorspool& horspool, const u8* hay, i64 hayLen)
+{
+    for(i64 p = hayLen - horspool.len; p >= 0; ) {
+        const u8 b = hay[p];
+        if((b & horspool.mask[0]) == horspool.data[0] && horspoolMatches(horspool, hay + p)) {
+            return p;
+        }
+        p -= horspool.shiftBackward[b];
+    }
+    return -1;
+}
+
+// sign extends the low size bytes of v
+static inline i64 signExtend(u64 v, i32 size)
+{
+    const i32 shift = 64 - size * 8;
+    return (i64)(v << shift) >> shift;
+}
+
+static inline i64 laneMax(i32 size)
+{
+    return size == 8 ? INT64_MAX : ((i64)1 << (size * 8 - 1)) - 1;
+}
+
+static inline i64 laneMin(i32 size)
+{
+    return -laneMax(size) - 1;
+}
+
+static inline u64 floatExpMask(i32 size)
+{
+    return size == 4 ? 0x7F800000ULL : 0x7FF0000000000000ULL;
+}
+
+// float bits (sign extended) to a signed int with the same order, neighbor floats are 1 apart
+static inline i64 floatOrdered(i64 bits, i32 size)
+{
+    return bits < 0 ? bits ^ laneMax(size) : bits;
+}
+
+bool searchNumericInitIntRange(SearchNumeric* num, i32 size, i64 lo, i64 hi)
+{
+    num->op = SearchNumericOp::INT_RANGE;
+    num->size = size;
+    num->flip = 0;
+    num->lo = MAX(lo, laneMin(size));
+    num->hi = MIN(hi, laneMax(size));
+    return num->lo <= num->hi;
+}
+
+bool searchNumericInitUintRange(SearchNumeric* num, i32 size, u64 lo, u64 hi)
+{
+    const u64 typeMax = size == 8 ? UINT64_MAX : ((u64)1 << (size * 8)) - 1;
+    const u64 signBit = (u64)1 << (size * 8 - 1);
+    hi = MIN(hi, typeMax);
+
+    num->op = SearchNumericOp::INT_RANGE;
+    num->size = size;
+    num->flip = (i64)signBit;
+    num->lo = signExtend(lo ^ signBit, size);
+    num->hi = signExtend(hi ^ signBit, size);
+    return lo <= hi;
+}
+
+bool searchNumericInitFloatRange(SearchNumeric* num, i32 size, f64 lo, f64 hi)
+{
+    assert(size == 4 || size == 8);
+    num->op = SearchNumericOp::FLOAT_RANGE;
+    num->size = size;
+    // f32 values are compared to f32 bounds
+    num->flo = size == 4 ? (f32)lo : lo;
+    num->fhi = size == 4 ? (f32)hi : hi;
+    return num->flo <= num->fhi; // false for NaN bounds too
+}
+
+bool searchNumericInitFloatTolerance(SearchNumeric* num, i32 size, f64 value, f64 eps)
+{
+    assert(size == 4 || size == 8);
+    num->op = SearchNumericOp::FLOAT_TOLERANCE;
+    num->size = size;
+    num->value = size == 4 ? (f32)value : value;
+    num->eps = size == 4 ? (f32)eps : eps;
+    return num->eps > 0 && num->value == num->value;
+}
+
+bool searchNumericInitFloatUlp(SearchNumeric* num, i32 size, f64 value, i64 ulps)
+{
+    assert(size == 4 || size == 8);
+    u64 bits = 0;
+    if(size == 4) {
+        const f32 v = (f32)value;
+        memcpy(&bits, &v, 4);
+    }
+    else {
+        memcpy(&bits, &value, 8);
+    }
+    const i64 ordered = floatOrdered(signExtend(bits, size), size);
+
+    num->op = SearchNumericOp::FLOAT_ULP;
+    num->size = size;
+    num->lo = ordered < laneMin(size) + ulps ? laneMin(size) : ordered - ulps;
+    num->hi = ordered > laneMax(size) - ulps ? laneMax(size) : ordered + ulps;
+    return ulps >= 0 && value == value;
+}
+
+void searchNumericInitNonFinite(SearchNumeric* num, i32 size)
+{
+    assert(size == 4 || size == 8);
+    num->op = SearchNumericOp::FLOAT_NON_FINITE;
+    num->size = size;
+}
+
+static bool numericMatchScalar(const SearchNumeric& num, const u8* p)
+{
+    u64 bits = 0;
+    if(num.bigEndian) {
+        for(i32 i = 0; i < num.size; i++) {
+            bits = (bits << 8) | p[i];
+        }
+    }
+    else {
+        memcpy(&bits, p, num.size);
+    }
+
+    switch(num.op) {
+        case SearchNumericOp::INT_RANGE: {
+            const i64 v = signExtend(bits ^ (u64)num.flip, num.size);
+            return v >= num.lo && v <= num.hi;
+        }
+
+        case SearchNumericOp::FLOAT_RANGE: {
+            f64 v;
+            if(num.size == 4) {
+                f32 v32;
+                memcpy(&v32, &bits, 4);
+                v = v32;
+            }
+            else {
+                memcpy(&v, &bits, 8);
+            }
+            return v >= num.flo && v <= num.fhi;
+        }
+
+        case SearchNumericOp::FLOAT_TOLERANCE: {
+            if(num.size == 4) {
+                f32 v;
+                memcpy(&v, &bits, 4);
+                return fabsf(v - (f32)num.value) < (f32)num.eps;
+            }
+            f64 v;
+            memcpy(&v, &bits, 8);
+            return fabs(v - num.value) < num.eps;
+        }
+
+        case SearchNumericOp::FLOAT_ULP: {
+            if((bits & (u64)laneMax(num.size)) > floatExpMask(num.size)) {
+                return false; // NaN
+            }
+            const i64 v = floatOrdered(signExtend(bits, num.size), num.size);
+            return v >= num.lo && v <= num.hi;
+        }
+
+        case SearchNumericOp::FLOAT_NON_FINITE: {
+            return (bits & floatExpMask(num.size)) == floatExpMask(num.size);
+        }
+    }
+    return false;
+}
+
+static i64 numericFindScalar(const SearchNumeric& num, const u8* data, i64 dataLen, i64 stride, i64 from)
+{
+    for(i64 p = from; p + num.size <= dataLen; p += stride) {
+        if(numericMatchScalar(num, data + p)) {
+            return p;
+        }
+    }
+    return -1;
+}
+
+// integer lanes of S bytes, LOW_BITS picks the first movemask bit of each lane
+template<i32 S> struct Avx2Lanes;
+
+template<> struct Avx2Lanes<1>
+{
+    static const u32 LOW_BITS = 0xFFFFFFFF;
+    SEARCH_TARGET_AVX2 static inline __m256i set1(i64 v) { return _mm256_set1_epi8((char)v); }
+    SEARCH_TARGET_AVX2 static inline __m256i sub(__m256i a, __m256i b) { return _mm256_sub_epi8(a, b); }
+    SEARCH_TARGET_AVX2 static inline __m256i cmpgt(__m256i a, __m256i b) { return _mm256_cmpgt_epi8(a, b); }
+    SEARCH_TARGET_AVX2 static inline __m256i cmpeq(__m256i a, __m256i b) { return _mm256_cmpeq_epi8(a, b); }
+};
+
+template<> struct Avx2Lanes<2>
+{
+    static const u32 LOW_BITS = 0x55555555;
+    SEARCH_TARGET_AVX2 static inline __m256i set1(i64 v) { return _mm256_set1_epi16((short)v); }
+    SEARCH_TARGET_AVX2 static inline __m256i sub(__m256i a, __m256i b) { return _mm256_sub_epi16(a, b); }
+    SEARCH_TARGET_AVX2 static inline __m256i cmpgt(__m256i a, __m256i b) { return _mm256_cmpgt_epi16(a, b); }
+    SEARCH_TARGET_AVX2 static inline __m256i cmpeq(__m256i a, __m256i b) { return _mm256_cmpeq_epi16(a, b); }
+};
+
+template<> struct Avx2Lanes<4>
+{
+    static const u32 LOW_BITS = 0x11111111;
+    SEARCH_TARGET_AVX2 static inline __m256i set1(i64 v) { return _mm256_set1_epi32((i32)v); }
+    SEARCH_TARGET_AVX2 static inline __m256i cmpgt(__m256i a, __m256i b) { return _mm256_cmpgt_epi32(a, b); }
+    SEARCH_TARGET_AVX2 static inline __m256i cmpeq(__m256i a, __m256i b) { return _mm256_cmpeq_epi32(a, b); }
+};
+
+template<> struct Avx2Lanes<8>
+{
+    static const u32 LOW_BITS = 0x01010101;
+    SEARCH_TARGET_AVX2 static inline __m256i set1(i64 v) { return _mm256_set1_epi64x(v); }
+    SEARCH_TARGET_AVX2 static inline __m256i cmpgt(__m256i a, __m256i b) { return _mm256_cmpgt_epi64(a, b); }
+    SEARCH_TARGET_AVX2 static inline __m256i cmpeq(__m256i a, __m256i b) { return _mm256_cmpeq_epi64(a, b); }
+};
+
+// lo <= v <= hi, lanes are all ones where the predicate holds
+template<i32 S>
+struct Avx2IntRange
+{
+    typedef Avx2Lanes<S> L;
+    __m256i flip, lo, hi;
+
+    SEARCH_TARGET_AVX2 Avx2IntRange(const SearchNumeric& num) {
+        flip = L::set1(num.flip);
+        lo = L::set1(num.lo);
+        hi = L::set1(num.hi);
+    }
+
+    SEARCH_TARGET_AVX2 inline __m256i eval(__m256i v) const {
+        v = _mm256_xor_si256(v, flip);
+        const __m256i out = _mm256_or_si256(L::cmpgt(lo, v), L::cmpgt(v, hi));
+        return _mm256_xor_si256(out, _mm256_set1_epi8(-1));
+    }
+};
+
+template<i32 S>
+struct Avx2FloatUlp
+{
+    typedef Avx2Lanes<S> L;
+    __m256i lo, hi, absMask, expMask;
+
+    SEARCH_TARGET_AVX2 Avx2FloatUlp(const SearchNumeric& num) {
+        lo = L::set1(num.lo);
+        hi = L::set1(num.hi);
+        absMask = L::set1(laneMax(S));
+        expMask = L::set1((i64)floatExpMask(S));
+    }
+
+    SEARCH_TARGET_AVX2 inline __m256i eval(__m256i v) const {
+        const __m256i absBits = _mm256_and_si256(v, absMask);
+        const __m256i isNaN = L::cmpgt(absBits, expMask);
+        const __m256i negative = L::cmpgt(_mm256_setzero_si256(), v);
+        const __m256i ordered = _mm256_xor_si256(v, _mm256_and_si256(negative, absMask));
+        const __m256i out = _mm256_or_si256(L::cmpgt(lo, ordered), L::cmpgt(ordered, hi));
+        return _mm256_xor_si256(_mm256_or_si256(out, isNaN), _mm256_set1_epi8(-1));
+    }
+};
+
+template<i32 S>
+struct Avx2FloatNonFinite
+{
+    typedef Avx2Lanes<S> L;
+    __m256i expMask;
+
+    SEARCH_TARGET_AVX2 Avx2FloatNonFinite(const SearchNumeric&) {
+        expMask = L::set1((i64)floatExpMask(S));
+    }
+
+    SEARCH_TARGET_AVX2 inline __m256i eval(__m256i v) const {
+        return L::cmpeq(_mm256_and_si256(v, expMask), expMask);
+    }
+};
+
+struct Avx2FloatRange4
+{
+    __m256 lo, hi;
+
+    SEARCH_TARGET_AVX2 Avx2FloatRange4(const SearchNumeric& num) {
+        lo = _mm256_set1_ps((f32)num.flo);
+        hi = _mm256_set1_ps((f32)num.fhi);
+    }
+
+    SEARCH_TARGET_AVX2 inline __m256i eval(__m256i v) const {
+        const __m256 x = _mm256_castsi256_ps(v);
+        return _mm256_castps_si256(_mm256_and_ps(_mm256_cmp_ps(x, lo, _CMP_GE_OQ), _mm256_cmp_ps(x, hi, _CMP_LE_OQ)));
+    }
+};
+
+struct Avx2FloatRange8
+{
+    __m256d lo, hi;
+
+    SEARCH_TARGET_AVX2 Avx2FloatRange8(const SearchNumeric& num) {
+        lo = _mm256_set1_pd(num.flo);
+        hi = _mm256_set1_pd(num.fhi);
+    }
+
+    SEARCH_TARGET_AVX2 inline __m256i eval(__m256i v) const {
+        const __m256d x = _mm256_castsi256_pd(v);
+        return _mm256_castpd_si256(_mm256_and_pd(_mm256_cmp_pd(x, lo, _CMP_GE_OQ), _mm256_cmp_pd(x, hi, _CMP_LE_OQ)));
+    }
+};
+
+struct Avx2FloatTolerance4
+{
+    __m256 value, eps, absMask;
+
+    SEARCH_TARGET_AVX2 Avx2FloatTolerance4(const SearchNumeric& num) {
+        value = _mm256_set1_ps((f32)num.value);
+        eps = _mm256_set1_ps((f32)num.eps);
+        absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    }
+
+    SEARCH_TARGET_AVX2 inline __m256i eval(__m256i v) const {
+        const __m256 diff = _mm256_and_ps(_mm256_sub_ps(_mm256_castsi256_ps(v), value), absMask);
+        return _mm256_castps_si256(_mm256_cmp_ps(diff, eps, _CMP_LT_OQ));
+    }
+};
+
+struct Avx2FloatTolerance8
+{
+    __m256d value, eps, absMask;
+
+    SEARCH_TARGET_AVX2 Avx2FloatTolerance8(const SearchNumeric& num) {
+        value = _mm256_set1_pd(num.value);
+        eps = _mm256_set1_pd(num.eps);
+        absMask = _mm256_castsi256_pd(_mm256_set1_epi64x(INT64_MAX));
+    }
+
+    SEARCH_TARGET_AVX2 inline __m256i eval(__m256i v) const {
+        const __m256d diff = _mm256_and_pd(_mm256_sub_pd(_mm256_castsi256_pd(v), value), absMask);
+        return _mm256_castpd_si256(_mm256_cmp_pd(diff, eps, _CMP_LT_OQ));
+    }
+};
+
+// pshufb mask reversing the bytes of each S byte lane
+template<i32 S>
+SEARCH_TARGET_AVX2
+static inline __m256i laneByteSwapMask()
+{
+    alignas(32) u8 shuffle[32];
+    for(i32 i = 0; i < 32; i++) {
+        shuffle[i] = (u8)((i % 16) / S * S + (S - 1 - i % S)); // pshufb indexes within each 128bit half
+    }
+    return _mm256_load_si256((const __m256i*)shuffle);
+}
+
+// Every 32 byte block is loaded once per stride phase (S / stride loads), each load covers the positions
+// phase * stride + k * S of the block. The lane masks are merged in one position bitmask.
+template<i32 S, typename Pred, bool SWAP_BYTES>
+SEARCH_TARGET_AVX2
+static i64 numericFindAVX2(const SearchNumeric& num, const u8* data, i64 dataLen, i64 stride)
+{
+    const Pred pred(num);
+    const __m256i swap = laneByteSwapMask<S>();
+    const i64 phaseCount = S / stride;
+    i64 b = 0;
+
+    for(; b + 32 + S - stride <= dataLen; b += 32) {
+        u32 hits = 0;
+        for(i64 phase = 0; phase < phaseCount; phase++) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(data + b + phase * stride));
+            if(SWAP_BYTES) {
+                v = _mm256_shuffle_epi8(v, swap);
+            }
+            hits |= ((u32)_mm256_movemask_epi8(pred.eval(v)) & Avx2Lanes<S>::LOW_BITS) << (phase * stride);
+        }
+        if(hits) {
+            return b + bitScanForward32(hits);
+        }
+    }
+
+    return numericFindScalar(num, data, dataLen, stride, b);
+}
+
+template<i32 S, typename Pred>
+static inline i64 numericFindAVX2Endian(const SearchNumeric& num, const u8* data, i64 dataLen, i64 stride)
+{
+    if(num.bigEndian) {
+        return numericFindAVX2<S, Pred, true>(num, data, dataLen, stride);
+    }
+    return numericFindAVX2<S, Pred, false>(num, data, dataLen, stride);
+}
+
+i64 searchNumericFind(const SearchNumeric& num, const u8* data, i64 dataLen, i64 stride)
+{
+    assert(stride > 0 && num.size % stride == 0);
+    if(!g_kernelAVX2) {
+        return numericFindScalar(num, data, dataLen, stride, 0);
+    }
+
+    const bool f32Lanes = num.size == 4;
+    switch(num.op) {
+        case SearchNumericOp::INT_RANGE: {
+            switch(num.size) {
+                case 1: return numericFindAVX2Endian<1, Avx2IntRange<1>>(num, data, dataLen, stride);
+                case 2: return numericFindAVX2Endian<2, Avx2IntRange<2>>(num, data, dataLen, stride);
+                case 4: return numericFindAVX2Endian<4, Avx2IntRange<4>>(num, data, dataLen, stride);
+                case 8: return numericFindAVX2Endian<8, Avx2IntRange<8>>(num, data, dataLen, stride);
+            }
+        } break;
+
+        case SearchNumericOp::FLOAT_RANGE: {
+            return f32Lanes ? numericFindAVX2Endian<4, Avx2FloatRange4>(num, data, dataLen, stride) :
+                              numericFindAVX2Endian<8, Avx2FloatRange8>(num, data, dataLen, stride);
+        }
+
+        case SearchNumericOp::FLOAT_TOLERANCE: {
+            return f32Lanes ? numericFindAVX2Endian<4, Avx2FloatTolerance4>(num, data, dataLen, stride) :
+                              numericFindAVX2Endian<8, Avx2FloatTolerance8>(num, data, dataLen, stride);
+        }
+
+        case SearchNumericOp::FLOAT_ULP: {
+            return f32Lanes ? numericFindAVX2Endian<4, Avx2FloatUlp<4>>(num, data, dataLen, stride) :
+                              numericFindAVX2Endian<8, Avx2FloatUlp<8>>(num, data, dataLen, stride);
+        }
+
+        case SearchNumericOp::FLOAT_NON_FINITE: {
+            return f32Lanes ? numericFindAVX2Endian<4, Avx2FloatNonFinite<4>>(num, data, dataLen, stride) :
+                              numericFindAVX2Endian<8, Avx2FloatNonFinite<8>>(num, data, dataLen, stride);
+        }
+    }
+
+    assert(0);
+    return -1;
+}
+
+bool searchRelativeInit(SearchRelative* rel, const u8* word, i32 wordLen, i32 elemSize)
+{
+    assert(elemSize == 1 || elemSize == 2);
+    assert(wordLen <= SEARCH_NEEDLE_MAX_LEN);
+    const u16 valueMask = elemSize == 1 ? 0xFF : 0xFFFF;
+
+    rel->elemSize = elemSize;
+    rel->deltaCount = MAX(0, wordLen - 1);
+    rel->len = wordLen * elemSize;
+    for(i32 k = 0; k < rel->deltaCount; k++) {
+        rel->deltas[k] = (u16)(word[k + 1] - word[k]) & valueMask;
+    }
+    return rel->deltaCount > 0;
+}
+
+static inline u16 relativeLoad(const u8* p, i32 elemSize)
+{
+    return elemSize == 1 ? p[0] : (u16)(p[0] | (p[1] << 8));
+}
+
+static i64 relativeFindScalar(const SearchRelative& rel, const u8* data, i64 dataLen, i64 stride, i64 from)
+{
+    const i32 e = rel.elemSize;
+    const u16 valueMask = e == 1 ? 0xFF : 0xFFFF;
+
+    for(i64 p = from; p + rel.len <= dataLen; p += stride) {
+        i32 k = 0;
+        for(; k < rel.deltaCount; k++) {
+            const u16 d = (u16)(relativeLoad(data + p + (k + 1) * e, e) - relativeLoad(data + p + k * e, e));
+            if((d & valueMask) != rel.deltas[k]) break;
+        }
+        if(k == rel.deltaCount) {
+            return p;
+        }
+    }
+    return -1;
+}
+
+// Same block and stride phase layout as numericFindAVX2, each lane is a candidate position.
+// The differences are checked one at a time while some candidate is left, most blocks stop after one or two.
+template<i32 S>
+SEARCH_TARGET_AVX2
+static i64 relativeFindAVX2(const SearchRelative& rel, const u8* data, i64 dataLen, i64 stride)
+{
+    typedef Avx2Lanes<S> L;
+    const i64 phaseCount = S / stride;
+    i64 b = 0;
+
+    for(; b + 32 + rel.len - stride <= dataLen; b += 32) {
+        u32 hits = 0;
+        for(i64 phase = 0; phase < phaseCount; phase++) {
+            const u8* p = data + b + phase * stride;
+            u32 mask = L::LOW_BITS;
+            __m256i prev = _mm256_loadu_si256((const __m256i*)p);
+
+            for(i32 k = 0; k < rel.deltaCount && mask; k++) {
+                const __m256i next = _mm256_loadu_si256((const __m256i*)(p + (k + 1) * S));
+                const __m256i eq = L::cmpeq(L::sub(next, prev), L::set1(rel.deltas[k]));
+                mask &= (u32)_mm256_movemask_epi8(eq);
+                prev = next;
+            }
+            hits |= (mask & L::LOW_BITS) << (phase * stride);
+        }
+        if(hits) {
+            return b + bitScanForward32(hits);
+        }
+    }
+
+    return relativeFindScalar(rel, data, dataLen, stride, b);
+}
+
+i64 searchRelativeFind(const SearchRelative& rel, const u8* data, i64 dataLen, i64 stride)
+{
+    assert(stride > 0 && rel.elemSize % stride == 0);
+    if(!g_kernelAVX2) {
+        return relativeFindScalar(rel, data, dataLen, stride, 0);
+    }
+    if(rel.elemSize == 1) {
+        return relativeFindAVX2<1>(rel, data, dataLen, stride);
+    }
+    return relativeFindAVX2<2>(rel, data, dataLen, stride);
+}
+
+// needle bytes repeated over 8 bytes, len divides 8
+static inline i64 needleBroadcast(const u8* bytes, i32 len)
+{
+    u8 lanes[8];
+    for(i32 i = 0; i < 8; i++) {
+        lanes[i] = bytes[i % len];
+    }
+    i64 v;
+    memcpy(&v, lanes, 8);
+    return v;
+}
+
+template<i32 S, i32 STRIDE>
+static i64 alignedFindScalar(const SearchNeedle& needle, const u8* hay, i64 hayLen, i64 from)
+{
+    for(i64 p = from; p + S <= hayLen; p += STRIDE) {
+        if(needleVerify(needle, hay + p)) {
+            return p;
+        }
+    }
+    return -1;
+}
+
+// Aligned needle of S bytes: every lane of a block holds the needle, each stride phase is one load and one
+// compare, the lane masks are merged in one position bitmask like numericFindAVX2.
+// SSE2 has no 64bit compare, bytes are compared and a lane keeps its first bit if its S bytes are all equal.
+template<i32 S, i32 STRIDE>
+static i64 alignedFindSSE2(const SearchNeedle& needle, const u8* hay, i64 hayLen)
+{
+    const __m128i data = _mm_set1_epi64x(needleBroadcast(needle.data, S));
+    const __m128i mask = _mm_set1_epi64x(needleBroadcast(needle.mask, S));
+    i64 b = 0;
+
+    for(; b + 16 + S - STRIDE <= hayLen; b += 16) {
+        u32 hits = 0;
+        for(i32 phase = 0; phase < S / STRIDE; phase++) {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(hay + b + phase * STRIDE));
+            u32 eq = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(v, mask), data));
+            if(S >= 2) eq &= eq >> 1;
+            if(S >= 4) eq &= eq >> 2;
+            if(S >= 8) eq &= eq >> 4;
+            hits |= (eq & Avx2Lanes<S>::LOW_BITS & 0xFFFF) << (phase * STRIDE);
+        }
+        if(hits) {
+            return b + bitScanForward32(hits);
+        }
+    }
+
+    return alignedFindScalar<S, STRIDE>(needle, hay, hayLen, b);
+}
+
+template<i32 S, i32 STRIDE>
+SEARCH_TARGET_AVX2
+static i64 alignedFindAVX2(const SearchNeedle& needle, const u8* hay, i64 hayLen)
+{
+    typedef Avx2Lanes<S> L;
+    const __m256i data = _mm256_set1_epi64x(needleBroadcast(needle.data, S));
+    const __m256i mask = _mm256_set1_epi64x(needleBroadcast(needle.mask, S));
+    i64 b = 0;
+
+    for(; b + 32 + S - STRIDE <= hayLen; b += 32) {
+        u32 hits = 0;
+        for(i32 phase = 0; phase < S / STRIDE; phase++) {
+            const __m256i v = _mm256_loadu_si256((const __m256i*)(hay + b + phase * STRIDE));
+            const __m256i eq = L::cmpeq(_mm256_and_si256(v, mask), data);
+            hits |= ((u32)_mm256_movemask_epi8(eq) & L::LOW_BITS) << (phase * STRIDE);
+        }
+        if(hits) {
+            return b + bitScanForward32(hits);
+        }
+    }
+
+    return alignedFindScalar<S, STRIDE>(needle, hay, hayLen, b);
+}
+
+// rare bytes scan, the hits off the stride are skipped
+static i64 strideFindSkip(const SearchNeedle& needle, const u8* hay, i64 hayLen, i64 stride)
+{
+    i64 p = 0;
+    while(true) {
+        const i64 found = searchFind(needle, hay + p, hayLen - p);
+        if(found < 0) {
+            return -1;
+        }
+        const i64 offset = p + found;
+        if(offset % stride == 0) {
+            return offset;
+        }
+        p = (offset / stride + 1) * stride; // not on the stride, skip to the next position
+    }
+}
+
+// the SSE2 half strides need 2 to 4 loads and the byte reduction per block, slower than the rare bytes scan
+template<i32 S, i32 STRIDE>
+static i64 alignedFind(const SearchNeedle& needle, const u8* hay, i64 hayLen)
+{
+    if(g_kernelAVX2) {
+        return alignedFindAVX2<S, STRIDE>(needle, hay, hayLen);
+    }
+    if(STRIDE == S) {
+        return alignedFindSSE2<S, STRIDE>(needle, hay, hayLen);
+    }
+    return strideFindSkip(needle, hay, hayLen, STRIDE);
+}
+
+i64 searchFindStride(const SearchNeedle& needle, const u8* hay, i64 hayLen, i64 stride)
+{
+    assert(stride > 0);
+    if(stride == 1) {
+        return searchFind(needle, hay, hayLen);
+    }
+
+    // Even and Twice strides of 16, 32 and 64bit values
+    const i32 len = needle.len;
+    if(len == 2 && stride == 2) return alignedFind<2, 2>(needle, hay, hayLen);
+    if(len == 4 && stride == 2) return alignedFind<4, 2>(needle, hay, hayLen);
+    if(len == 4 && stride == 4) return alignedFind<4, 4>(needle, hay, hayLen);
+    if(len == 8 && stride == 4) return alignedFind<8, 4>(needle, hay, hayLen);
+    if(len == 8 && stride == 8) return alignedFind<8, 8>(needle, hay, hayLen);
+
+    return strideFindSkip(needle, hay, hayLen, stride);
+}
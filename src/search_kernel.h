@@ -0,0 +1,120 @@
+#pragma once
+#include "base.h"
+
+#define SEARCH_NEEDLE_MAX_LEN 128
+
+/**
+ *  SearchNeedle
+ *  - the pattern plus the 2 rarest bytes in it, by a fixed byte frequency estimate
+ *  - the kernels scan for the rare bytes at their relative positions and only verify the candidates
+ */
+struct SearchNeedle
+{
+    u8 data[SEARCH_NEEDLE_MAX_LEN]; // pre-masked
+    u8 mask[SEARCH_NEEDLE_MAX_LEN];
+    i32 len = 0;
+    i32 rare1 = 0; // position of the rarest byte
+    i32 rare2 = 0; // position of the second rarest byte
+    bool masked = false; // some bits are wildcards, matches are verified with mask instead of memcmp
+};
+
+void searchNeedleInit(SearchNeedle* needle, const u8* data, i32 len);
+// A byte matches when (byte & mask) == (data & mask)
+void searchNeedleInitMasked(SearchNeedle* needle, const u8* data, const u8* mask, i32 len);
+
+// Parses an IDA style pattern: "4D 5A ?? ?? 50 45 ?0", ?? or ? is any byte, ?0 / 0? a nibble,
+// 40/F0 is a byte value with a bit mask. Returns the byte count or 0 if invalid.
+i32 searchParseMaskedPattern(const char* text, u8* data, u8* mask, i32 maxLen);
+
+// Picks the best kernel for this cpu, call once before searchFind
+void searchKernelInit();
+
+// Returns the position of the first occurrence of the needle in hay[0, hayLen) or -1
+i64 searchFind(const SearchNeedle& needle, const u8* hay, i64 hayLen);
+// Same as searchFind with positions multiple of stride only. 2, 4 and 8 byte needles with a stride of their
+// length or half of it compare whole lanes with the broadcast needle, other needles skip the off-stride hits
+i64 searchFindStride(const SearchNeedle& needle, const u8* hay, i64 hayLen, i64 stride);
+
+/**
+ *  SearchHorspool
+ *  - Boyer-Moore-Horspool skip tables of a needle, one per direction
+ *  - no setup pass over the data, find next / previous stop at the first hit from any position
+ *  - a wildcard bit makes its position match several bytes, which shortens their shifts
+ */
+struct SearchHorspool
+{
+    u8 data[SEARCH_NEEDLE_MAX_LEN]; // pre-masked
+    u8 mask[SEARCH_NEEDLE_MAX_LEN];
+    i32 len = 0;
+    i32 shiftForward[256];  // by the byte under the last needle position
+    i32 shiftBackward[256]; // by the byte under the first needle position
+};
+
+// A byte matches when (byte & mask) == (data & mask)
+void searchHorspoolInit(SearchHorspool* horspool, const u8* data, const u8* mask, i32 len);
+// Returns the position of the first occurrence in hay[0, hayLen) or -1
+i64 searchHorspoolFind(const SearchHorspool& horspool, const u8* hay, i64 hayLen);
+// Returns the position of the last occurrence in hay[0, hayLen) or -1
+i64 searchHorspoolFindLast(const SearchHorspool& horspool, const u8* hay, i64 hayLen);
+
+struct SearchNumericOp
+{
+    enum Enum: i32 {
+        INT_RANGE = 0,    // lo <= v <= hi
+        FLOAT_RANGE,      // flo <= v <= fhi, never NaN
+        FLOAT_TOLERANCE,  // |v - value| < eps
+        FLOAT_ULP,        // at most n representable floats away from value (lo/hi in ordered int space)
+        FLOAT_NON_FINITE, // NaN or +-inf
+    };
+};
+
+/**
+ *  SearchNumeric
+ *  - predicate on a 1, 2, 4 or 8 byte value, evaluated at every stride position
+ *  - the AVX2 kernel compares a whole vector of lanes per stride phase, the scalar one is the fallback
+ *  - unsigned ints have their sign bit flipped (flip) so every integer compare is signed
+ */
+struct SearchNumeric
+{
+    SearchNumericOp::Enum op = SearchNumericOp::INT_RANGE;
+    i32 size = 4;
+    bool bigEndian = false; // lanes are byte swapped (pshufb) before the compare
+    i64 flip = 0;
+    i64 lo = 0; // sign extended lane values
+    i64 hi = 0;
+    f64 flo = 0;
+    f64 fhi = 0;
+    f64 value = 0;
+    f64 eps = 0;
+};
+
+// Bounds are clamped to the type, returns false if no value can match
+bool searchNumericInitIntRange(SearchNumeric* num, i32 size, i64 lo, i64 hi);
+bool searchNumericInitUintRange(SearchNumeric* num, i32 size, u64 lo, u64 hi);
+bool searchNumericInitFloatRange(SearchNumeric* num, i32 size, f64 lo, f64 hi);
+bool searchNumericInitFloatTolerance(SearchNumeric* num, i32 size, f64 value, f64 eps);
+bool searchNumericInitFloatUlp(SearchNumeric* num, i32 size, f64 value, i64 ulps);
+void searchNumericInitNonFinite(SearchNumeric* num, i32 size);
+
+// Returns the first position p of data (multiple of stride, p + size <= dataLen) where the predicate holds or -1
+i64 searchNumericFind(const SearchNumeric& num, const u8* data, i64 dataLen, i64 stride);
+
+/**
+ *  SearchRelative
+ *  - relative search: consecutive 8 or 16 bit values with the same differences as the word,
+ *    whatever the first value is (table encoded text)
+ *  - the AVX2 kernel tests 32 candidate positions per block, one difference at a time
+ */
+struct SearchRelative
+{
+    u16 deltas[SEARCH_NEEDLE_MAX_LEN]; // value[k+1] - value[k], wrapping
+    i32 deltaCount = 0;
+    i32 elemSize = 1; // 1 or 2 bytes, little endian
+    i32 len = 0; // bytes covered by a match
+};
+
+// Returns false if the word has less than 2 values
+bool searchRelativeInit(SearchRelative* rel, const u8* word, i32 wordLen, i32 elemSize);
+
+// Returns the first position p of data (multiple of stride, p + len <= dataLen) that matches or -1
+i64 searchRelativeFind(const SearchRelative& rel, const u8* data, i64 dataLen, i64 stride);
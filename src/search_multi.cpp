@@ -0,0 +1,152 @@
+#include "search_multi.h"
+
+static inline i32 hexDigitValue(char c)
+{
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parses [cur, end) into pattern, returns false if the line is not a valid pattern
+static bool parsePatternLine(const char* cur, const char* end, SearchPattern* pattern)
+{
+    pattern->len = 0;
+    while(cur < end && (*cur == ' ' || *cur == '\t' || *cur == '\r')) cur++;
+    if(cur == end) {
+        return false;
+    }
+
+    // "string"
+    if(*cur == '"') {
+        cur++;
+        while(cur < end && *cur != '"') {
+            if(pattern->len >= SEARCH_PATTERN_MAX_LEN) return false;
+            pattern->data[pattern->len++] = *cur++;
+        }
+        return cur < end && pattern->len > 0;
+    }
+
+    // hex bytes, spaces are optional
+    while(cur < end) {
+        if(*cur == ' ' || *cur == '\t' || *cur == '\r') {
+            cur++;
+            continue;
+        }
+        if(cur + 1 >= end) return false;
+        const i32 hi = hexDigitValue(cur[0]);
+        const i32 lo = hexDigitValue(cur[1]);
+        if(hi < 0 || lo < 0 || pattern->len >= SEARCH_PATTERN_MAX_LEN) return false;
+        pattern->data[pattern->len++] = (u8)((hi << 4) | lo);
+        cur += 2;
+    }
+    return pattern->len > 0;
+}
+
+i32 searchParsePatterns(const char* text, SearchPattern* patterns, i32 maxCount)
+{
+    i32 count = 0;
+    const char* cur = text;
+
+    while(*cur && count < maxCount) {
+        const char* lineEnd = cur;
+        while(*lineEnd && *lineEnd != '\n') lineEnd++;
+
+        if(parsePatternLine(cur, lineEnd, &patterns[count])) {
+            count++;
+        }
+        else if(lineEnd > cur) {
+            LOG("Search> skipping invalid pattern '%.*s'", (i32)(lineEnd - cur), cur);
+        }
+
+        cur = *lineEnd ? lineEnd + 1 : lineEnd;
+    }
+    return count;
+}
+
+void SearchAutomaton::build(const SearchPattern* patterns, i32 patternCount)
+{
+    transitions.clear();
+    outStart.clear();
+    outPatterns.clear();
+    patternLens.clear();
+    minLen = patternCount > 0 ? SEARCH_PATTERN_MAX_LEN : 0;
+    maxLen = 0;
+
+    // trie, -1 is no edge yet
+    Array<Array<i32>> ownOutputs;
+    transitions.resize(256, -1);
+    ownOutputs.resize(1);
+    stateCount = 1;
+
+    for(i32 p = 0; p < patternCount; p++) {
+        const SearchPattern& pat = patterns[p];
+        i32 state = 0;
+        for(i32 i = 0; i < pat.len; i++) {
+            i32& next = transitions[state * 256 + pat.data[i]];
+            if(next < 0) {
+                next = stateCount++;
+                transitions.resize(stateCount * 256, -1);
+                ownOutputs.resize(stateCount);
+            }
+            // transitions may have moved
+            state = transitions[state * 256 + pat.data[i]];
+        }
+        ownOutputs[state].push(p);
+        patternLens.push(pat.len);
+        minLen = MIN(minLen, pat.len);
+        maxLen = MAX(maxLen, pat.len);
+    }
+
+    // breadth first: fill the missing edges with the failure state ones, which are already complete
+    Array<i32> fail;
+    Array<i32> queue;
+    fail.resize(stateCount, 0);
+    queue.reserve(stateCount);
+
+    for(i32 c = 0; c < 256; c++) {
+        i32& next = transitions[c];
+        if(next < 0) {
+            next = 0;
+        }
+        else {
+            queue.push(next);
+        }
+    }
+
+    // outputs are the state own patterns then the failure state ones, built in the same order
+    Array<Array<i32>> outputs;
+    outputs.resize(stateCount);
+    outputs[0] = ownOutputs[0];
+
+    for(i32 q = 0; q < queue.count(); q++) {
+        const i32 state = queue[q];
+        outputs[state] = ownOutputs[state];
+        const Array<i32>& failOut = outputs[fail[state]];
+        for(i32 o = 0; o < failOut.count(); o++) {
+            outputs[state].push(failOut[o]);
+        }
+
+        for(i32 c = 0; c < 256; c++) {
+            const i32 next = transitions[state * 256 + c];
+            if(next < 0) {
+                transitions[state * 256 + c] = transitions[fail[state] * 256 + c];
+            }
+            else {
+                fail[next] = transitions[fail[state] * 256 + c];
+                queue.push(next);
+            }
+        }
+    }
+
+    outStart.reserve(stateCount + 1);
+    for(i32 s = 0; s < stateCount; s++) {
+        outStart.push(outPatterns.count());
+        for(i32 o = 0; o < outputs[s].count(); o++) {
+            outPatterns.push(outputs[s][o]);
+        }
+    }
+    outStart.push(outPatterns.count());
+
+    LOG("Search> automaton built, %d patterns, %d states", patternCount, stateCount);
+}
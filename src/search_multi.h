@@ -0,0 +1,43 @@
+#pragma once
+#include "base.h"
+#include "utils.h"
+
+#define SEARCH_PATTERN_MAX_LEN 64
+#define SEARCH_PATTERN_MAX_COUNT 1024
+
+struct SearchPattern
+{
+    u8 data[SEARCH_PATTERN_MAX_LEN];
+    i32 len = 0;
+};
+
+// One pattern per line, either hex bytes (4D 5A 90 00) or a quoted string ("PK").
+// Returns the pattern count, invalid lines are skipped.
+i32 searchParsePatterns(const char* text, SearchPattern* patterns, i32 maxCount);
+
+/**
+ *  SearchAutomaton
+ *  - Aho-Corasick automaton of a pattern set, compiled down to a dense DFA (256 transitions per state)
+ *  - one pass over the data reports every occurrence of every pattern, overlapping ones included
+ *  - outputs of a state are the patterns ending there, outPatterns[outStart[s], outStart[s+1])
+ */
+struct SearchAutomaton
+{
+    Array<i32> transitions;
+    Array<i32> outStart;
+    Array<i32> outPatterns;
+    Array<i32> patternLens;
+    i32 stateCount = 0;
+    i32 minLen = 0;
+    i32 maxLen = 0;
+
+    void build(const SearchPattern* patterns, i32 patternCount);
+
+    inline i32 step(i32 state, u8 byte) const {
+        return transitions[state * 256 + byte];
+    }
+
+    inline bool hasOutput(i32 state) const {
+        return outStart[state] != outStart[state + 1];
+    }
+};
@@ -0,0 +1,694 @@
+#include "search_regex.h"
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+
+#define REGEX_MAX_REPEAT 1000
+#define REGEX_INF_LEN 0x7FFFFFFF
+
+struct RegexNode
+{
+    enum Kind: i32 {
+        SET = 0, // one byte of set
+        CONCAT,  // a then b
+        ALT,     // a or b
+        REPEAT,  // a, min to max times (max -1 is unbounded)
+    };
+
+    Kind kind;
+    i32 set = -1;
+    i32 a = -1;
+    i32 b = -1;
+    i32 min = 0;
+    i32 max = 0;
+};
+
+static void byteSetClear(SearchRegex::ByteSet* set)
+{
+    memset(set->bits, 0, sizeof(set->bits));
+}
+
+static void byteSetAddRange(SearchRegex::ByteSet* set, i32 first, i32 last)
+{
+    for(i32 b = first; b <= last; b++) {
+        set->bits[b >> 5] |= 1u << (b & 31);
+    }
+}
+
+static void byteSetAddSet(SearchRegex::ByteSet* set, const SearchRegex::ByteSet& other)
+{
+    for(i32 i = 0; i < 8; i++) {
+        set->bits[i] |= other.bits[i];
+    }
+}
+
+static void byteSetInvert(SearchRegex::ByteSet* set)
+{
+    for(i32 i = 0; i < 8; i++) {
+        set->bits[i] = ~set->bits[i];
+    }
+}
+
+static inline i32 regexHexDigit(char c)
+{
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ *  RegexParser
+ *  - recursive descent, builds the expression tree in nodes
+ *  - alt := concat ('|' concat)*, concat := repeat+, repeat := atom quantifier*
+ */
+struct RegexParser
+{
+    const char* cur;
+    Array<RegexNode> nodes;
+    Array<SearchRegex::ByteSet> sets;
+    char* error;
+    i32 errorSize;
+    bool failed = false;
+
+    i32 fail(const char* msg) {
+        if(!failed) {
+            snprintf(error, errorSize, "%s", msg);
+            failed = true;
+        }
+        return -1;
+    }
+
+    i32 newNode(const RegexNode& node) {
+        nodes.push(node);
+        return nodes.count() - 1;
+    }
+
+    i32 newSetNode(const SearchRegex::ByteSet& set) {
+        sets.push(set);
+        RegexNode node;
+        node.kind = RegexNode::SET;
+        node.set = sets.count() - 1;
+        return newNode(node);
+    }
+
+    // \d \w \s and their negations, returns false if c is not a class escape
+    bool escapeClass(char c, SearchRegex::ByteSet* set) {
+        byteSetClear(set);
+        switch(c) {
+            case 'd': case 'D': {
+                byteSetAddRange(set, '0', '9');
+            } break;
+            case 'w': case 'W': {
+                byteSetAddRange(set, '0', '9');
+                byteSetAddRange(set, 'a', 'z');
+                byteSetAddRange(set, 'A', 'Z');
+                byteSetAddRange(set, '_', '_');
+            } break;
+            case 's': case 'S': {
+                byteSetAddRange(set, '\t', '\r');
+                byteSetAddRange(set, ' ', ' ');
+            } break;
+            default: return false;
+        }
+        if(c >= 'A' && c <= 'Z') {
+            byteSetInvert(set);
+        }
+        return true;
+    }
+
+    // Single byte escape after the backslash, returns -1 on error
+    i32 escapeByte() {
+        const char c = *cur++;
+        switch(c) {
+            case 'x': {
+                const i32 hi = regexHexDigit(cur[0]);
+                const i32 lo = hi >= 0 ? regexHexDigit(cur[1]) : -1;
+                if(lo < 0) {
+                    return fail("\\x expects 2 hex digits");
+                }
+                cur += 2;
+                return (hi << 4) | lo;
+            }
+            case 'n': return '\n';
+            case 'r': return '\r';
+            case 't': return '\t';
+            case '0': return 0;
+            case 0: {
+                cur--;
+                return fail("Trailing backslash");
+            }
+        }
+        if((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+            return fail("Unknown escape");
+        }
+        return (u8)c; // escaped punctuation
+    }
+
+    i32 parseClass() {
+        SearchRegex::ByteSet set;
+        byteSetClear(&set);
+        const bool negate = *cur == '^';
+        if(negate) cur++;
+
+        bool first = true;
+        while(*cur && (*cur != ']' || first)) {
+            first = false;
+            i32 lo;
+            if(*cur == '\\') {
+                cur++;
+                SearchRegex::ByteSet cls;
+                if(escapeClass(*cur, &cls)) {
+                    cur++;
+                    byteSetAddSet(&set, cls);
+                    continue;
+                }
+                lo = escapeByte();
+                if(lo < 0) return -1;
+            }
+            else {
+                lo = (u8)*cur++;
+            }
+
+            i32 hi = lo;
+            if(cur[0] == '-' && cur[1] && cur[1] != ']') {
+                cur++;
+                if(*cur == '\\') {
+                    cur++;
+                    hi = escapeByte();
+                    if(hi < 0) return -1;
+                }
+                else {
+                    hi = (u8)*cur++;
+                }
+                if(hi < lo) {
+                    return fail("Invalid class range");
+                }
+            }
+            byteSetAddRange(&set, lo, hi);
+        }
+
+        if(*cur != ']') {
+            return fail("Missing ]");
+        }
+        cur++;
+
+        if(negate) {
+            byteSetInvert(&set);
+        }
+        return newSetNode(set);
+    }
+
+    i32 parseAtom() {
+        SearchRegex::ByteSet set;
+        const char c = *cur;
+
+        if(c == '(') {
+            cur++;
+            const i32 node = parseAlt();
+            if(node < 0) return -1;
+            if(*cur != ')') {
+                return fail("Missing )");
+            }
+            cur++;
+            return node;
+        }
+        if(c == '[') {
+            cur++;
+            return parseClass();
+        }
+        if(c == '.') {
+            cur++;
+            byteSetClear(&set);
+            byteSetAddRange(&set, 0, 255);
+            return newSetNode(set);
+        }
+        if(c == '\\') {
+            cur++;
+            if(escapeClass(*cur, &set)) {
+                cur++;
+                return newSetNode(set);
+            }
+            const i32 b = escapeByte();
+            if(b < 0) return -1;
+            byteSetClear(&set);
+            byteSetAddRange(&set, b, b);
+            return newSetNode(set);
+        }
+        if(c == '*' || c == '+' || c == '?' || c == '{') {
+            return fail("Nothing to repeat");
+        }
+        if(c == ')') {
+            return fail("Unmatched )");
+        }
+
+        cur++;
+        byteSetClear(&set);
+        byteSetAddRange(&set, (u8)c, (u8)c);
+        return newSetNode(set);
+    }
+
+    // Parses a repeat count, returns -1 if there are no digits
+    i32 parseCount() {
+        if(*cur < '0' || *cur > '9') {
+            return -1;
+        }
+        i32 count = 0;
+        while(*cur >= '0' && *cur <= '9') {
+            count = MIN(count * 10 + (*cur - '0'), REGEX_MAX_REPEAT + 1);
+            cur++;
+        }
+        return count;
+    }
+
+    i32 parseRepeat() {
+        i32 node = parseAtom();
+
+        while(node >= 0) {
+            RegexNode rep;
+            rep.kind = RegexNode::REPEAT;
+            rep.a = node;
+
+            if(*cur == '*') {
+                rep.min = 0;
+                rep.max = -1;
+                cur++;
+            }
+            else if(*cur == '+') {
+                rep.min = 1;
+                rep.max = -1;
+                cur++;
+            }
+            else if(*cur == '?') {
+                rep.min = 0;
+                rep.max = 1;
+                cur++;
+            }
+            else if(*cur == '{') {
+                cur++;
+                rep.min = parseCount();
+                rep.max = rep.min;
+                if(*cur == ',') {
+                    cur++;
+                    rep.max = parseCount();
+                }
+                if(rep.min < 0 || *cur != '}') {
+                    return fail("Invalid {n,m} repeat");
+                }
+                cur++;
+                if(rep.min > REGEX_MAX_REPEAT || rep.max > REGEX_MAX_REPEAT) {
+                    return fail("Repeat count over 1000");
+                }
+                if(rep.max >= 0 && rep.max < rep.min) {
+                    return fail("Invalid {n,m} repeat");
+                }
+            }
+            else {
+                break;
+            }
+
+            node = newNode(rep);
+        }
+        return node;
+    }
+
+    i32 parseConcat() {
+        i32 node = -1;
+        while(*cur && *cur != '|' && *cur != ')') {
+            const i32 next = parseRepeat();
+            if(next < 0) return -1;
+
+            if(node < 0) {
+                node = next;
+            }
+            else {
+                RegexNode cat;
+                cat.kind = RegexNode::CONCAT;
+                cat.a = node;
+                cat.b = next;
+                node = newNode(cat);
+            }
+        }
+        if(node < 0) {
+            return fail("Empty expression");
+        }
+        return node;
+    }
+
+    i32 parseAlt() {
+        i32 node = parseConcat();
+        while(node >= 0 && *cur == '|') {
+            cur++;
+            const i32 next = parseConcat();
+            if(next < 0) return -1;
+
+            RegexNode alt;
+            alt.kind = RegexNode::ALT;
+            alt.a = node;
+            alt.b = next;
+            node = newNode(alt);
+        }
+        return node;
+    }
+};
+
+// match length bounds of a node, REGEX_INF_LEN when unbounded
+static void regexNodeLen(const Array<RegexNode>& nodes, i32 n, i64* minLen, i64* maxLen)
+{
+    const RegexNode& node = nodes[n];
+    i64 amin, amax, bmin, bmax;
+
+    switch(node.kind) {
+        case RegexNode::SET: {
+            *minLen = 1;
+            *maxLen = 1;
+        } break;
+
+        case RegexNode::CONCAT: {
+            regexNodeLen(nodes, node.a, &amin, &amax);
+            regexNodeLen(nodes, node.b, &bmin, &bmax);
+            *minLen = amin + bmin;
+            *maxLen = MIN(amax + bmax, (i64)REGEX_INF_LEN);
+        } break;
+
+        case RegexNode::ALT: {
+            regexNodeLen(nodes, node.a, &amin, &amax);
+            regexNodeLen(nodes, node.b, &bmin, &bmax);
+            *minLen = MIN(amin, bmin);
+            *maxLen = MAX(amax, bmax);
+        } break;
+
+        case RegexNode::REPEAT: {
+            regexNodeLen(nodes, node.a, &amin, &amax);
+            *minLen = MIN(amin * node.min, (i64)REGEX_INF_LEN);
+            if(node.max < 0) {
+                *maxLen = amax > 0 ? REGEX_INF_LEN : 0;
+            }
+            else {
+                *maxLen = MIN(amax * node.max, (i64)REGEX_INF_LEN);
+            }
+        } break;
+    }
+}
+
+/**
+ *  RegexCompiler
+ *  - Thompson construction, every fragment has one entry and one exit epsilon state
+ *  - bounded repeats are unrolled, hence the state limit
+ */
+struct RegexCompiler
+{
+    const Array<RegexNode>& nodes;
+    SearchRegex* regex;
+    bool overflow = false;
+
+    struct Frag
+    {
+        i32 in;
+        i32 out; // epsilon state with no transition yet
+    };
+
+    RegexCompiler(const Array<RegexNode>& nodes_, SearchRegex* regex_): nodes(nodes_), regex(regex_) {}
+
+    i32 newState(SearchRegex::NfaState::Type type) {
+        if(regex->states.count() >= SEARCH_REGEX_MAX_NFA_STATES) {
+            overflow = true;
+        }
+        SearchRegex::NfaState state;
+        state.type = type;
+        regex->states.push(state);
+        return regex->states.count() - 1;
+    }
+
+    inline void link(i32 from, i32 to) {
+        if(overflow) return;
+        SearchRegex::NfaState& s = regex->states[from];
+        if(s.out0 < 0) {
+            s.out0 = to;
+        }
+        else {
+            assert(s.out1 < 0);
+            s.out1 = to;
+        }
+    }
+
+    Frag emit(i32 n) {
+        const RegexNode& node = nodes[n];
+        Frag f;
+
+        if(overflow) {
+            f.in = f.out = 0;
+            return f;
+        }
+
+        switch(node.kind) {
+            case RegexNode::SET: {
+                f.in = newState(SearchRegex::NfaState::BYTE_SET);
+                f.out = newState(SearchRegex::NfaState::EPSILON);
+                regex->states[f.in].set = node.set;
+                regex->states[f.in].out0 = f.out;
+            } break;
+
+            case RegexNode::CONCAT: {
+                const Frag a = emit(node.a);
+                const Frag b = emit(node.b);
+                link(a.out, b.in);
+                f.in = a.in;
+                f.out = b.out;
+            } break;
+
+            case RegexNode::ALT: {
+                f.in = newState(SearchRegex::NfaState::EPSILON);
+                const Frag a = emit(node.a);
+                const Frag b = emit(node.b);
+                f.out = newState(SearchRegex::NfaState::EPSILON);
+                link(f.in, a.in);
+                link(f.in, b.in);
+                link(a.out, f.out);
+                link(b.out, f.out);
+            } break;
+
+            case RegexNode::REPEAT: {
+                f.in = newState(SearchRegex::NfaState::EPSILON);
+                f.out = f.in;
+
+                for(i32 i = 0; i < node.min && !overflow; i++) {
+                    const Frag a = emit(node.a);
+                    link(f.out, a.in);
+                    f.out = a.out;
+                }
+
+                if(node.max < 0) {
+                    // loop: out -> a -> out, out -> exit
+                    const i32 loop = newState(SearchRegex::NfaState::EPSILON);
+                    const Frag a = emit(node.a);
+                    const i32 exit = newState(SearchRegex::NfaState::EPSILON);
+                    link(f.out, loop);
+                    link(loop, a.in);
+                    link(loop, exit);
+                    link(a.out, loop);
+                    f.out = exit;
+                }
+                else {
+                    for(i32 i = node.min; i < node.max && !overflow; i++) {
+                        const i32 opt = newState(SearchRegex::NfaState::EPSILON);
+                        const Frag a = emit(node.a);
+                        const i32 exit = newState(SearchRegex::NfaState::EPSILON);
+                        link(f.out, opt);
+                        link(opt, a.in);
+                        link(opt, exit);
+                        link(a.out, exit);
+                        f.out = exit;
+                    }
+                }
+            } break;
+        }
+
+        return f;
+    }
+};
+
+bool SearchRegex::compile(const char* pattern, char* error, i32 errorSize)
+{
+    states.clear();
+    sets.clear();
+    startState = -1;
+    error[0] = 0;
+
+    RegexParser parser;
+    parser.cur = pattern;
+    parser.error = error;
+    parser.errorSize = errorSize;
+
+    const i32 root = parser.parseAlt();
+    if(root < 0) {
+        return false;
+    }
+    if(*parser.cur) {
+        parser.fail(*parser.cur == ')' ? "Unmatched )" : "Unexpected character");
+        return false;
+    }
+
+    i64 rootMin, rootMax;
+    regexNodeLen(parser.nodes, root, &rootMin, &rootMax);
+    if(rootMin == 0) {
+        snprintf(error, errorSize, "Matches the empty string");
+        return false;
+    }
+    minLen = (i32)MIN(rootMin, (i64)SEARCH_REGEX_MAX_MATCH_LEN);
+    maxLen = (i32)MIN(rootMax, (i64)SEARCH_REGEX_MAX_MATCH_LEN);
+
+    sets = parser.sets;
+    RegexCompiler compiler(parser.nodes, this);
+    const RegexCompiler::Frag frag = compiler.emit(root);
+    const i32 match = compiler.newState(NfaState::MATCH);
+    if(compiler.overflow) {
+        snprintf(error, errorSize, "Expression too complex");
+        states.clear();
+        return false;
+    }
+    compiler.link(frag.out, match);
+    startState = frag.in;
+
+    // first bytes: every byte set reachable from the start through epsilons
+    byteSetClear(&firstBytes);
+    Array<u8> visited;
+    visited.resize(states.count(), 0);
+    Array<i32> stack;
+    stack.push(startState);
+    visited[startState] = 1;
+    while(stack.count() > 0) {
+        const NfaState& s = states[stack.last()];
+        stack.pop();
+
+        if(s.type == NfaState::BYTE_SET) {
+            byteSetAddSet(&firstBytes, sets[s.set]);
+            continue;
+        }
+        if(s.type == NfaState::EPSILON) {
+            if(s.out0 >= 0 && !visited[s.out0]) {
+                visited[s.out0] = 1;
+                stack.push(s.out0);
+            }
+            if(s.out1 >= 0 && !visited[s.out1]) {
+                visited[s.out1] = 1;
+                stack.push(s.out1);
+            }
+        }
+    }
+
+    return true;
+}
+
+// Epsilon closure of nfaSet in place, only keeps byte set and match states (sorted)
+static void regexClosure(const SearchRegex& regex, Array<i32>* nfaSet, Array<u32>* visited, u32* visitStamp,
+                         Array<i32>* stack)
+{
+    const u32 stamp = ++(*visitStamp);
+    stack->clear();
+    for(i32 id: *nfaSet) {
+        if((*visited)[id] != stamp) {
+            (*visited)[id] = stamp;
+            stack->push(id);
+        }
+    }
+    nfaSet->clear();
+
+    while(stack->count() > 0) {
+        const i32 id = stack->last();
+        stack->pop();
+        const SearchRegex::NfaState& s = regex.states[id];
+
+        if(s.type != SearchRegex::NfaState::EPSILON) {
+            nfaSet->push(id);
+            continue;
+        }
+        if(s.out0 >= 0 && (*visited)[s.out0] != stamp) {
+            (*visited)[s.out0] = stamp;
+            stack->push(s.out0);
+        }
+        if(s.out1 >= 0 && (*visited)[s.out1] != stamp) {
+            (*visited)[s.out1] = stamp;
+            stack->push(s.out1);
+        }
+    }
+
+    std::sort(nfaSet->begin(), nfaSet->end());
+}
+
+void SearchRegexDfa::init(const SearchRegex* regex_, bool anchored_)
+{
+    regex = regex_;
+    anchored = anchored_;
+    visited.clear();
+    visited.resize(regex->states.count(), 0);
+    visitStamp = 0;
+    _flush();
+}
+
+void SearchRegexDfa::_flush()
+{
+    transitions.clear();
+    stateSets.clear();
+    stateIsMatch.clear();
+    stateOfSet.clear();
+
+    // the dead state loops on itself
+    Array<i32> empty;
+    _addState(&empty);
+    for(i32 b = 0; b < 256; b++) {
+        transitions[DEAD_STATE * 256 + b] = DEAD_STATE;
+    }
+
+    Array<i32> startSet;
+    startSet.push(regex->startState);
+    regexClosure(*regex, &startSet, &visited, &visitStamp, &stack);
+    start = _addState(&startSet);
+}
+
+i32 SearchRegexDfa::_addState(Array<i32>* nfaSet)
+{
+    std::string key((const char*)nfaSet->data(), nfaSet->count() * sizeof(i32));
+    auto found = stateOfSet.find(key);
+    if(found != stateOfSet.end()) {
+        return found->second;
+    }
+
+    const i32 id = stateSets.count();
+    bool match = false;
+    for(i32 s: *nfaSet) {
+        match |= regex->states[s].type == SearchRegex::NfaState::MATCH;
+    }
+
+    stateSets.push(*nfaSet);
+    stateIsMatch.push(match);
+    transitions.resize(transitions.count() + 256, UNKNOWN);
+    stateOfSet.emplace(key, id);
+    return id;
+}
+
+i32 SearchRegexDfa::_computeStep(i32 state, u8 byte)
+{
+    // cache full, start over with only the state we are in
+    if(stateSets.count() >= MAX_STATES) {
+        Array<i32> current = stateSets[state];
+        _flush();
+        state = _addState(&current);
+    }
+
+    Array<i32> next;
+    for(i32 id: stateSets[state]) {
+        const SearchRegex::NfaState& s = regex->states[id];
+        if(s.type == SearchRegex::NfaState::BYTE_SET && regex->sets[s.set].has(byte)) {
+            next.push(s.out0);
+        }
+    }
+    if(!anchored) {
+        next.push(regex->startState); // a match can start at the next byte too
+    }
+
+    regexClosure(*regex, &next, &visited, &visitStamp, &stack);
+    const i32 nextState = _addState(&next);
+    transitions[state * 256 + byte] = nextState;
+    return nextState;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "base.h"
+#include "utils.h"
+#include <unordered_map>
+#include <string>
+
+// longest match reported, unbounded repetitions are cut there
+#define SEARCH_REGEX_MAX_MATCH_LEN (64 * 1024)
+#define SEARCH_REGEX_MAX_NFA_STATES 20000
+
+/**
+ *  SearchRegex
+ *  - byte oriented regular expression compiled to a Thompson NFA
+ *  - syntax: literals, . (any byte), \xNN, \d \w \s \D \W \S, [a-z\x00-\x1F] classes and [^...],
+ *    ( ), |, * + ? {n} {n,} {n,m}
+ *  - expressions matching the empty string are rejected, every match is at least 1 byte
+ *  - immutable once compiled, shared by every search worker
+ */
+struct SearchRegex
+{
+    struct NfaState
+    {
+        enum Type: i32 {
+            EPSILON = 0, // out0, out1 (-1 if unused)
+            BYTE_SET,    // set, out0
+            MATCH,
+        };
+
+        Type type;
+        i32 out0 = -1;
+        i32 out1 = -1;
+        i32 set = -1;
+    };
+
+    struct ByteSet
+    {
+        u32 bits[8];
+
+        inline bool has(u8 b) const {
+            return (bits[b >> 5] >> (b & 31)) & 1;
+        }
+    };
+
+    Array<NfaState> states;
+    Array<ByteSet> sets;
+    i32 startState = -1;
+    ByteSet firstBytes; // bytes a match can start with
+    i32 minLen = 0;
+    i32 maxLen = 0; // capped to SEARCH_REGEX_MAX_MATCH_LEN
+
+    // Returns false and fills error on failure
+    bool compile(const char* pattern, char* error, i32 errorSize);
+};
+
+/**
+ *  SearchRegexDfa
+ *  - lazily built DFA over a SearchRegex, a DFA state is a set of NFA states
+ *  - transitions are computed on first use and cached, the cache is flushed when it gets too big
+ *  - unanchored DFAs restart a match at every position, used to find where the first match ends
+ *  - not thread safe, each worker has its own
+ */
+struct SearchRegexDfa
+{
+    enum: i32 {
+        DEAD_STATE = 0,
+        UNKNOWN = -1,
+        MAX_STATES = 4096,
+    };
+
+    const SearchRegex* regex = nullptr;
+    bool anchored = true;
+    Array<i32> transitions; // stateCount * 256
+    Array<Array<i32>> stateSets;
+    Array<u8> stateIsMatch;
+    std::unordered_map<std::string, i32> stateOfSet;
+    i32 start = -1;
+
+    // closure scratch
+    Array<u32> visited;
+    u32 visitStamp = 0;
+    Array<i32> stack;
+
+    void init(const SearchRegex* regex_, bool anchored_);
+
+    inline i32 step(i32 state, u8 byte) {
+        const i32 next = transitions[state * 256 + byte];
+        if(next != UNKNOWN) {
+            return next;
+        }
+        return _computeStep(state, byte);
+    }
+
+    inline bool isMatch(i32 state) const {
+        return stateIsMatch[state] != 0;
+    }
+
+    // Start state id, may change after a cache flush
+    inline i32 startState() {
+        return start;
+    }
+
+    i32 _computeStep(i32 state, u8 byte);
+    i32 _addState(Array<i32>* nfaSet);
+    void _flush();
+};
@@ -0,0 +1,199 @@
+#include "search_results.h"
+#include <utility>
+
+void SearchResultList::reset(SearchDataType::Enum type_, i32 resultLen_)
+{
+    clear();
+    type = type_;
+    resultLen = resultLen_;
+    patternLens.clear();
+}
+
+void SearchResultList::resetMultiPattern(const i32* patternLens_, i32 patternCount)
+{
+    clear();
+    type = SearchDataType::Multi_Pattern;
+    resultLen = 0;
+    patternLens.clear();
+    for(i32 p = 0; p < patternCount; p++) {
+        patternLens.push(patternLens_[p]);
+        resultLen = MAX(resultLen, patternLens_[p]);
+    }
+}
+
+void SearchResultList::clear()
+{
+    resultCount.store(0);
+    blocks.clear();
+    deltaBytes.clear();
+    lastOffset = 0;
+}
+
+void SearchResultList::swap(SearchResultList* other)
+{
+    std::swap(type, other->type);
+    std::swap(resultLen, other->resultLen);
+    std::swap(patternLens, other->patternLens);
+    blocks.swap(other->blocks);
+    deltaBytes.swap(other->deltaBytes);
+    std::swap(lastOffset, other->lastOffset);
+
+    const i64 otherCount = other->resultCount.load();
+    other->resultCount.store(resultCount.load());
+    resultCount.store(otherCount);
+}
+
+static inline void pushVarint(ArraySegmentedTS<u8>* bytes, u64 val)
+{
+    while(val >= 0x80) {
+        bytes->push((u8)(val | 0x80));
+        val >>= 7;
+    }
+    bytes->push((u8)val);
+}
+
+void SearchResultList::push(i64 offset, i32 patternId, i32 len)
+{
+    const i64 index = resultCount.load(std::memory_order_relaxed);
+
+    if((index & SEARCH_RESULT_BLOCK_MASK) == 0) {
+        Block b;
+        b.firstOffset = offset;
+        b.byteStart = deltaBytes.count();
+        blocks.push(b);
+    }
+    else {
+        assert(offset >= lastOffset);
+        pushVarint(&deltaBytes, offset - lastOffset);
+    }
+
+    if(isMultiPattern()) {
+        assert(patternId >= 0 && patternId < patternLens.count());
+        pushVarint(&deltaBytes, patternId);
+    }
+    else if(isVariableLen()) {
+        assert(len > 0 && len <= resultLen);
+        pushVarint(&deltaBytes, len);
+    }
+
+    lastOffset = offset;
+    // publish once the bytes are written
+    resultCount.store(index + 1, std::memory_order_release);
+}
+
+static inline u64 readVarint(const ArraySegmentedTS<u8>& bytes, i64* pos)
+{
+    u64 val = 0;
+    i32 shift = 0;
+    u8 byte;
+    do {
+        byte = bytes[(*pos)++];
+        val |= (u64)(byte & 0x7f) << shift;
+        shift += 7;
+    } while(byte & 0x80);
+    return val;
+}
+
+// Reads what follows the delta of the result at cursor->bytePos
+void SearchResultList::_readEntry(Cursor* cursor) const
+{
+    cursor->patternId = 0;
+    if(isMultiPattern()) {
+        cursor->patternId = (i32)readVarint(deltaBytes, &cursor->bytePos);
+        cursor->len = patternLens[cursor->patternId];
+    }
+    else if(isVariableLen()) {
+        cursor->len = (i32)readVarint(deltaBytes, &cursor->bytePos);
+    }
+    else {
+        cursor->len = resultLen;
+    }
+}
+
+SearchResultList::Cursor SearchResultList::seek(i64 index) const
+{
+    assert(index >= 0 && index < count());
+    const Block& b = blocks[index >> SEARCH_RESULT_BLOCK_SHIFT];
+    Cursor c;
+    c.index = index & ~(i64)SEARCH_RESULT_BLOCK_MASK;
+    c.offset = b.firstOffset;
+    c.bytePos = b.byteStart;
+    _readEntry(&c);
+
+    while(c.index < index) {
+        c.index++;
+        c.offset += readVarint(deltaBytes, &c.bytePos);
+        _readEntry(&c);
+    }
+    return c;
+}
+
+void SearchResultList::next(Cursor* cursor) const
+{
+    cursor->index++;
+    assert(cursor->index < count());
+
+    // blocks are contiguous in deltaBytes, only the first offset comes from the directory
+    if((cursor->index & SEARCH_RESULT_BLOCK_MASK) == 0) {
+        cursor->offset = blocks[cursor->index >> SEARCH_RESULT_BLOCK_SHIFT].firstOffset;
+    }
+    else {
+        cursor->offset += readVarint(deltaBytes, &cursor->bytePos);
+    }
+    _readEntry(cursor);
+}
+
+SearchResult SearchResultList::get(i64 index) const
+{
+    const Cursor c = seek(index);
+    SearchResult r;
+    r.offset = c.offset;
+    r.len = c.len;
+    r.type = type;
+    r.patternId = c.patternId;
+    return r;
+}
+
+i64 SearchResultList::lowerBound(i64 offset) const
+{
+    const i64 n = count();
+    if(n == 0) {
+        return 0;
+    }
+
+    // first block starting at or after offset
+    const i64 blockCount = ((n - 1) >> SEARCH_RESULT_BLOCK_SHIFT) + 1;
+    i64 lo = 0;
+    i64 hi = blockCount;
+    while(lo < hi) {
+        const i64 mid = (lo + hi) / 2;
+        if(blocks[mid].firstOffset < offset) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    if(lo == 0) {
+        return 0;
+    }
+
+    // the answer is in the previous block or is the first result of block lo
+    const i64 blockEnd = MIN(n, lo << SEARCH_RESULT_BLOCK_SHIFT);
+    Cursor c = seek((lo - 1) << SEARCH_RESULT_BLOCK_SHIFT);
+    while(c.offset < offset) {
+        if(c.index + 1 >= blockEnd) {
+            return blockEnd;
+        }
+        next(&c);
+    }
+    return c.index;
+}
+
+void SearchResultList::findOverlapping(i64 start, i64 end, i64* first, i64* last) const
+{
+    // no result is longer than resultLen, the caller skips the ones ending before start
+    *first = lowerBound(start - resultLen + 1);
+    *last = MAX(*first, lowerBound(end));
+}
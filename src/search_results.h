@@ -0,0 +1,113 @@
+#pragma once
+#include "base.h"
+#include "utils.h"
+
+struct SearchDataType
+{
+    enum Enum: i32 {
+        ASCII_String,
+        Integer,
+        Float,
+        Multi_Pattern,
+        Masked_Pattern,
+        Regex,
+        Relative,
+        Approximate,
+    };
+};
+
+struct SearchResult
+{
+	i64 offset;
+    i32 len;
+    SearchDataType::Enum type;
+    i32 patternId = 0;
+};
+
+#define SEARCH_RESULT_BLOCK_SHIFT 7
+#define SEARCH_RESULT_BLOCK_SIZE (1 << SEARCH_RESULT_BLOCK_SHIFT)
+#define SEARCH_RESULT_BLOCK_MASK (SEARCH_RESULT_BLOCK_SIZE - 1)
+
+/**
+ *  SearchResultList
+ *  - results of one query, sorted by offset
+ *  - len and type are the same for the whole query and only stored once
+ *  - offsets are varint encoded deltas, in blocks of 128 results. The block directory holds the first offset
+ *    of each block so random access decodes at most one block (1-3 bytes per result instead of 16)
+ *  - multi pattern queries store the pattern id of each result after its delta, lengths come from patternLens
+ *  - regex and approximate queries store the length of each result after its delta
+ *  - one writer (the search thread), readers only see results below count()
+ *  - reset() and clear() must not race with the writer (the search is stopped first)
+ */
+struct SearchResultList
+{
+    struct Block
+    {
+        i64 firstOffset;
+        i64 byteStart;
+    };
+
+    SearchDataType::Enum type = SearchDataType::ASCII_String;
+    i32 resultLen = 0; // longest result
+    Array<i32> patternLens; // multi pattern only, length of each pattern
+
+    ArraySegmentedTS<Block> blocks;
+    ArraySegmentedTS<u8> deltaBytes;
+    std::atomic<i64> resultCount{0};
+    i64 lastOffset = 0; // writer only
+
+    void reset(SearchDataType::Enum type_, i32 resultLen_);
+    void resetMultiPattern(const i32* patternLens_, i32 patternCount);
+    void clear();
+    // Exchanges the results of both lists, same constraints as reset()
+    void swap(SearchResultList* other);
+
+    // Sequential read position, cheaper than get() when walking consecutive results
+    struct Cursor
+    {
+        i64 index;
+        i64 offset;
+        i64 bytePos;
+        i32 patternId;
+        i32 len;
+    };
+
+    // Offsets must be pushed in increasing order, len is only stored for variable length results
+    void push(i64 offset, i32 patternId = 0, i32 len = 0);
+    SearchResult get(i64 index) const;
+
+    Cursor seek(i64 index) const;
+    void next(Cursor* cursor) const;
+
+    // Index of the first result at or after offset (count() if none), O(log n)
+    i64 lowerBound(i64 offset) const;
+    // Results that may overlap [start, end) are [*first, *last), they all do when results have the same length
+    void findOverlapping(i64 start, i64 end, i64* first, i64* last) const;
+
+    inline bool isMultiPattern() const {
+        return type == SearchDataType::Multi_Pattern;
+    }
+
+    inline bool isVariableLen() const {
+        return type == SearchDataType::Regex || type == SearchDataType::Approximate;
+    }
+
+    void _readEntry(Cursor* cursor) const;
+
+    inline i64 count() const {
+        return resultCount.load(std::memory_order_acquire);
+    }
+
+    inline i64 memoryUsage() const {
+        return blocks.segmentCount * blocks.SEGMENT_SIZE * sizeof(Block) +
+               deltaBytes.segmentCount * deltaBytes.SEGMENT_SIZE;
+    }
+};
+
+// Highlight color of a multi pattern result, hues spread by the golden ratio so neighbor ids stand out
+inline u32 searchPatternColor(i32 patternId)
+{
+    Color3 rgb;
+    hsvToRgb({ fmodf(0.58f + patternId * 0.618034f, 1.0f), 0.45f, 1.0f }, &rgb);
+    return rgbToU32(rgb);
+}
@@ -0,0 +1,523 @@
+#include "search_suffix.h"
+#include <SDL_thread.h>
+#include <SDL_timer.h>
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+#include <queue>
+
+#define SUFFIX_NAIVE_LEN 10
+#define SUFFIX_CANCEL_MASK ((1 << 20) - 1) // buildCancel is checked every million suffixes
+
+template<typename T>
+static void suffixSortNaive(const T* s, i32 n, i32* sa)
+{
+    for(i32 i = 0; i < n; i++) {
+        sa[i] = i;
+    }
+    std::sort(sa, sa + n, [s, n](i32 a, i32 b) {
+        while(a < n && b < n && s[a] == s[b]) {
+            a++;
+            b++;
+        }
+        if(a == n) return b != n; // a prefix sorts first
+        if(b == n) return false;
+        return s[a] < s[b];
+    });
+}
+
+static inline bool suffixCancelled(const std::atomic<bool>* cancel)
+{
+    return cancel && cancel->load(std::memory_order_relaxed);
+}
+
+// SA-IS (Nong, Zhang, Chan): the LMS suffixes are sorted by induction, recursing on their names
+// when two LMS substrings are equal, then every other suffix is induced from them.
+// The names and the reduced string live in the unused end of sa, LMS suffixes are at least 2 apart.
+// Values of s are in [0, upper]. Returns false if cancel was raised.
+template<typename T>
+static bool suffixSais(const T* s, i32 n, i32 upper, i32* sa, const std::atomic<bool>* cancel)
+{
+    if(n == 0) {
+        return true;
+    }
+    if(n < SUFFIX_NAIVE_LEN) {
+        suffixSortNaive(s, n, sa);
+        return true;
+    }
+
+    // ls[i]: suffix i is S type (smaller than suffix i+1), the last one is L type
+    Array<u8> ls;
+    ls.resize(n, 0);
+    for(i32 i = n - 2; i >= 0; i--) {
+        ls[i] = s[i] == s[i + 1] ? ls[i + 1] : s[i] < s[i + 1];
+    }
+    if(suffixCancelled(cancel)) {
+        return false;
+    }
+
+    // bucket bounds: sumL[c] start of the L part of bucket c, sumS[c] start of its S part
+    Array<i32> sumL;
+    Array<i32> sumS;
+    sumL.resize(upper + 2, 0);
+    sumS.resize(upper + 2, 0);
+    for(i32 i = 0; i < n; i++) {
+        if(!ls[i]) {
+            sumS[s[i]]++;
+        }
+        else {
+            sumL[s[i] + 1]++;
+        }
+    }
+    for(i32 c = 0; c <= upper; c++) {
+        sumS[c] += sumL[c];
+        sumL[c + 1] += sumS[c];
+    }
+    if(suffixCancelled(cancel)) {
+        return false;
+    }
+
+    Array<i32> buff;
+    buff.resize(upper + 2);
+    auto induce = [&](const Array<i32>& lms) {
+        memset(sa, 0xFF, sizeof(i32) * n);
+
+        memcpy(buff.data(), sumS.data(), sizeof(i32) * (upper + 2));
+        const i32 lmsCount = lms.count();
+        for(i32 i = 0; i < lmsCount; i++) {
+            sa[buff[s[lms[i]]]++] = lms[i];
+            if((i & SUFFIX_CANCEL_MASK) == 0 && suffixCancelled(cancel)) {
+                return false;
+            }
+        }
+
+        // L type from left to right, the last suffix first
+        memcpy(buff.data(), sumL.data(), sizeof(i32) * (upper + 2));
+        sa[buff[s[n - 1]]++] = n - 1;
+        for(i32 i = 0; i < n; i++) {
+            const i32 v = sa[i];
+            if(v >= 1 && !ls[v - 1]) {
+                sa[buff[s[v - 1]]++] = v - 1;
+            }
+            if((i & SUFFIX_CANCEL_MASK) == 0 && suffixCancelled(cancel)) {
+                return false;
+            }
+        }
+
+        // S type from right to left
+        memcpy(buff.data(), sumL.data(), sizeof(i32) * (upper + 2));
+        for(i32 i = n - 1; i >= 0; i--) {
+            const i32 v = sa[i];
+            if(v >= 1 && ls[v - 1]) {
+                sa[--buff[s[v - 1] + 1]] = v - 1;
+            }
+            if((i & SUFFIX_CANCEL_MASK) == 0 && suffixCancelled(cancel)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // LMS: S type with an L type on the left
+    auto isLms = [&](i32 i) {
+        return i > 0 && ls[i] && !ls[i - 1];
+    };
+    i32 m = 0;
+    for(i32 i = 1; i < n; i++) {
+        m += isLms(i);
+    }
+    if(suffixCancelled(cancel)) {
+        return false;
+    }
+    Array<i32> lms;
+    lms.reserve(m);
+    for(i32 i = 1; i < n; i++) {
+        if(isLms(i)) {
+            lms.push(i);
+        }
+    }
+    if(suffixCancelled(cancel)) {
+        return false;
+    }
+
+    if(!induce(lms)) {
+        return false;
+    }
+    if(m == 0) {
+        return true;
+    }
+
+    // LMS suffixes in their induced order, moved to the front of sa
+    i32 sorted = 0;
+    for(i32 i = 0; i < n; i++) {
+        if(isLms(sa[i])) {
+            sa[sorted++] = sa[i];
+        }
+        if((i & SUFFIX_CANCEL_MASK) == 0 && suffixCancelled(cancel)) {
+            return false;
+        }
+    }
+    assert(sorted == m);
+
+    // name the LMS substrings in that order, equal ones get the same name (stored at sa[m + p/2])
+    auto lmsEnd = [&](i32 p) {
+        i32 end = p + 1;
+        while(end < n && !isLms(end)) {
+            end++;
+        }
+        return end;
+    };
+    memset(sa + m, 0xFF, sizeof(i32) * (n - m));
+    i32 recUpper = 0;
+    i32 prev = sa[0];
+    i32 prevEnd = lmsEnd(prev);
+    sa[m + (prev >> 1)] = 0;
+    for(i32 i = 1; i < m; i++) {
+        const i32 cur = sa[i];
+        const i32 curEnd = lmsEnd(cur);
+        // the last LMS substring runs into the end of the text and is unique
+        bool same = curEnd - cur == prevEnd - prev && curEnd < n && prevEnd < n;
+        for(i32 j = 0; same && j <= curEnd - cur; j++) {
+            same = s[cur + j] == s[prev + j];
+        }
+        if(!same) {
+            recUpper++;
+        }
+        sa[m + (cur >> 1)] = recUpper;
+        prev = cur;
+        prevEnd = curEnd;
+
+        if((i & SUFFIX_CANCEL_MASK) == 0 && suffixCancelled(cancel)) {
+            return false;
+        }
+    }
+
+    // reduced string: the names in text order, packed at the end of sa
+    i32* recS = sa + n - m;
+    for(i32 i = n - 1, j = n - 1; i >= m; i--) {
+        if(sa[i] >= 0) {
+            sa[j--] = sa[i];
+        }
+    }
+
+    // sort the reduced string in sa[0, m), directly when every name is unique
+    if(recUpper + 1 == m) {
+        for(i32 i = 0; i < m; i++) {
+            sa[recS[i]] = i;
+        }
+    }
+    else if(!suffixSais(recS, m, recUpper, sa, cancel)) {
+        return false;
+    }
+
+    for(i32 i = 0; i < m; i++) {
+        sa[i] = lms[sa[i]];
+    }
+    memcpy(lms.data(), sa, sizeof(i32) * m);
+    return induce(lms);
+}
+
+bool searchSuffixSort(const u8* s, i32 n, i32* sa, const std::atomic<bool>* cancel)
+{
+    return suffixSais(s, n, 255, sa, cancel);
+}
+
+// Kasai through the permuted LCP: consecutive text positions lose at most one common byte
+bool searchSuffixLcp(const u8* s, i32 n, const i32* sa, i32* lcp, i32* temp, const std::atomic<bool>* cancel)
+{
+    if(n == 0) {
+        return true;
+    }
+
+    // temp[p]: suffix before p in the array, then the common prefix with it
+    temp[sa[0]] = -1;
+    for(i32 i = 1; i < n; i++) {
+        temp[sa[i]] = sa[i - 1];
+        if((i & SUFFIX_CANCEL_MASK) == 0 && suffixCancelled(cancel)) {
+            return false;
+        }
+    }
+
+    i32 l = 0;
+    for(i32 p = 0; p < n; p++) {
+        const i32 prev = temp[p];
+        if(prev < 0) {
+            temp[p] = 0;
+            l = 0;
+            continue;
+        }
+        while(p + l < n && prev + l < n && s[p + l] == s[prev + l]) {
+            l++;
+        }
+        temp[p] = l;
+        l = MAX(l - 1, 0);
+
+        if((p & SUFFIX_CANCEL_MASK) == 0 && suffixCancelled(cancel)) {
+            return false;
+        }
+    }
+
+    for(i32 i = 0; i < n; i++) {
+        lcp[i] = temp[sa[i]];
+        if((i & SUFFIX_CANCEL_MASK) == 0 && suffixCancelled(cancel)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A repeat is reported once per group of occurrences (a range of the array where lcp >= len).
+// Only adjacent suffixes with different preceding bytes are candidates, the others are the tail of a longer repeat.
+static void suffixFindRepeats(SearchSuffixArray* sfx)
+{
+    const i32 n = sfx->len;
+    const u8* text = sfx->text;
+    const i32* sa = sfx->sa;
+    const i32* lcp = sfx->lcp;
+
+    // longest candidates, the shortest of them on top
+    typedef std::pair<i32,i32> Candidate; // len, array index
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> heap;
+    for(i32 i = 1; i < n; i++) {
+        const i32 len = lcp[i];
+        if(len == 0 || (heap.size() == SEARCH_SUFFIX_REPEAT_CANDIDATES && len <= heap.top().first)) {
+            continue;
+        }
+        const i32 a = sa[i - 1];
+        const i32 b = sa[i];
+        if(a > 0 && b > 0 && text[a - 1] == text[b - 1]) {
+            continue;
+        }
+        heap.push({ len, i });
+        if(heap.size() > SEARCH_SUFFIX_REPEAT_CANDIDATES) {
+            heap.pop();
+        }
+    }
+
+    Array<Candidate> candidates;
+    while(!heap.empty()) {
+        candidates.push(heap.top());
+        heap.pop();
+    }
+
+    struct Group { i32 lo, hi, len; };
+    Array<Group> groups;
+    sfx->repeats.clear();
+    for(i32 c = candidates.count() - 1; c >= 0 && sfx->repeats.count() < SEARCH_SUFFIX_REPEAT_COUNT; c--) {
+        const i32 len = candidates[c].first;
+        i32 lo = candidates[c].second - 1;
+        i32 hi = candidates[c].second;
+        while(lo > 0 && lcp[lo] >= len) {
+            lo--;
+        }
+        while(hi + 1 < n && lcp[hi + 1] >= len) {
+            hi++;
+        }
+
+        bool known = false;
+        for(const Group& g: groups) {
+            known |= g.lo == lo && g.hi == hi && g.len == len;
+        }
+        if(known) {
+            continue;
+        }
+        groups.push({ lo, hi, len });
+
+        i32 first = sa[lo];
+        for(i32 i = lo + 1; i <= hi; i++) {
+            first = MIN(first, sa[i]);
+        }
+        sfx->repeats.push({ sfx->base + first, len, hi - lo + 1 });
+    }
+}
+
+static i32 thread_searchSuffixBuild(void* ptr)
+{
+    SearchSuffixArray& sfx = *(SearchSuffixArray*)ptr;
+    const i32 n = sfx.len;
+    u32 t0 = SDL_GetTicks();
+
+    // read in chunks, a paged source goes to the disk
+    sfx.textBuff.resize(n);
+    bool ok = true;
+    for(i32 done = 0; ok && done < n && !sfx.buildCancel.load(); done += FILE_LOAD_CHUNK_SIZE) {
+        const i32 chunk = MIN(n - done, FILE_LOAD_CHUNK_SIZE);
+        ok = sfx.source->read(sfx.base + done, sfx.textBuff.data() + done, chunk, FileReadHint::STREAM) == chunk;
+    }
+
+    if(ok && !sfx.buildCancel.load()) {
+        sfx.saBuff.resize(n);
+        ok = searchSuffixSort(sfx.textBuff.data(), n, sfx.saBuff.data(), &sfx.buildCancel);
+    }
+    if(ok && !sfx.buildCancel.load()) {
+        Array<i32> temp;
+        temp.resize(n);
+        sfx.lcpBuff.resize(n);
+        ok = searchSuffixLcp(sfx.textBuff.data(), n, sfx.saBuff.data(), sfx.lcpBuff.data(), temp.data(),
+                             &sfx.buildCancel);
+    }
+    ok = ok && !sfx.buildCancel.load();
+
+    if(!ok) {
+        Array<u8>().swap(sfx.textBuff);
+        Array<i32>().swap(sfx.saBuff);
+        Array<i32>().swap(sfx.lcpBuff);
+        sfx.state.store(SearchIndexState::NONE, std::memory_order_release);
+        return 0;
+    }
+
+    sfx.text = sfx.textBuff.data();
+    sfx.sa = sfx.saBuff.data();
+    sfx.lcp = sfx.lcpBuff.data();
+    suffixFindRepeats(&sfx);
+
+    if(n > SEARCH_SUFFIX_SPILL_LEN && !sfx._spill()) {
+        LOG("SearchSuffixArray> could not spill to '%s', keeping it in memory", sfx.spillPath);
+    }
+
+    LOG("SearchSuffixArray> %d bytes sorted in %ums", n, SDL_GetTicks() - t0);
+    sfx.state.store(SearchIndexState::READY, std::memory_order_release);
+    return 0;
+}
+
+// Moves text, suffixes and LCP to a mapped file, the OS pages them back in when queried
+bool SearchSuffixArray::_spill()
+{
+    FILE* f = fopen(spillPath, "wb");
+    if(!f) {
+        return false;
+    }
+    // ints first, the mapping is page aligned
+    bool written = fwrite(saBuff.data(), sizeof(i32), len, f) == (size_t)len &&
+                   fwrite(lcpBuff.data(), sizeof(i32), len, f) == (size_t)len &&
+                   fwrite(textBuff.data(), 1, len, f) == (size_t)len;
+    written = fclose(f) == 0 && written;
+
+    // no prefetch thread, only the queried pages are read back
+    if(!written || !spill.openMapped(spillPath, FileMapMode::LAZY)) {
+        remove(spillPath);
+        return false;
+    }
+
+    sa = (const i32*)spill.data;
+    lcp = sa + len;
+    text = (const u8*)(lcp + len);
+    Array<u8>().swap(textBuff);
+    Array<i32>().swap(saBuff);
+    Array<i32>().swap(lcpBuff);
+    return true;
+}
+
+bool SearchSuffixArray::build(const FileSource* source_, i64 start, i64 size, const char* spillPath_)
+{
+    close();
+
+    if(size <= 0 || size > SEARCH_SUFFIX_MAX_LEN || start < 0 || start + size > source_->available()) {
+        return false;
+    }
+
+    source = source_;
+    base = start;
+    len = (i32)size;
+    snprintf(spillPath, sizeof(spillPath), "%s", spillPath_);
+    buildCancel.store(false);
+    state.store(SearchIndexState::BUILDING);
+    buildThread = SDL_CreateThread(thread_searchSuffixBuild, "SearchSuffix", this);
+    return true;
+}
+
+void SearchSuffixArray::close()
+{
+    // the sort and LCP passes check buildCancel, this doesn't wait for a whole build
+    if(buildThread) {
+        buildCancel.store(true);
+        i32 status;
+        SDL_WaitThread(buildThread, &status);
+        buildThread = nullptr;
+    }
+
+    if(spill.isOpen()) {
+        spill.close();
+        remove(spillPath);
+    }
+    Array<u8>().swap(textBuff);
+    Array<i32>().swap(saBuff);
+    Array<i32>().swap(lcpBuff);
+    repeats.clear();
+    text = nullptr;
+    sa = nullptr;
+    lcp = nullptr;
+    len = 0;
+    source = nullptr;
+    state.store(SearchIndexState::NONE);
+}
+
+// <0 if the suffix at p sorts before pattern, 0 if it starts with it
+static inline i32 suffixCompare(const SearchSuffixArray& sfx, i32 p, const u8* pattern, i32 patternLen)
+{
+    const i32 avail = sfx.len - p;
+    const i32 cmp = memcmp(sfx.text + p, pattern, MIN(avail, patternLen));
+    if(cmp != 0) {
+        return cmp;
+    }
+    return avail < patternLen ? -1 : 0;
+}
+
+void SearchSuffixArray::find(const u8* pattern, i32 patternLen, i32* first, i32* last) const
+{
+    assert(isReady());
+
+    // lower bound: first suffix not before pattern
+    i32 lo = 0;
+    i32 hi = len;
+    while(lo < hi) {
+        const i32 mid = lo + (hi - lo) / 2;
+        if(suffixCompare(*this, sa[mid], pattern, patternLen) < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    *first = lo;
+
+    // upper bound: first suffix after the ones starting with pattern
+    hi = len;
+    while(lo < hi) {
+        const i32 mid = lo + (hi - lo) / 2;
+        if(suffixCompare(*this, sa[mid], pattern, patternLen) <= 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    *last = lo;
+}
+
+i64 SearchSuffixArray::occurrences(const u8* pattern, i32 patternLen, Array<i64>* offsets, i32 maxCount) const
+{
+    offsets->clear();
+    if(patternLen <= 0) {
+        return 0;
+    }
+
+    i32 first, last;
+    find(pattern, patternLen, &first, &last);
+
+    // keep the maxCount smallest offsets in a max heap
+    for(i32 i = first; i < last; i++) {
+        const i64 offset = base + sa[i];
+        if(offsets->count() < maxCount) {
+            offsets->push(offset);
+            std::push_heap(offsets->begin(), offsets->end());
+        }
+        else if(maxCount > 0 && offset < offsets->front()) {
+            std::pop_heap(offsets->begin(), offsets->end());
+            offsets->last() = offset;
+            std::push_heap(offsets->begin(), offsets->end());
+        }
+    }
+    std::sort_heap(offsets->begin(), offsets->end());
+    return last - first;
+}
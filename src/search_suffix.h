@@ -0,0 +1,73 @@
+#pragma once
+#include "base.h"
+#include "utils.h"
+#include "file_source.h"
+#include "search_index.h"
+#include <atomic>
+
+#define SEARCH_SUFFIX_MAX_LEN (256 * 1024 * 1024) // i32 suffixes, 13 bytes of memory per byte at peak (3.3GB)
+#define SEARCH_SUFFIX_SPILL_LEN (16 * 1024 * 1024) // larger arrays are moved to disk once built
+#define SEARCH_SUFFIX_REPEAT_COUNT 32
+#define SEARCH_SUFFIX_REPEAT_CANDIDATES 512
+
+struct SearchRepeat
+{
+    i64 offset; // first occurrence, file offset
+    i32 len;
+    i32 count;
+};
+
+/**
+ *  SearchSuffixArray
+ *  - suffix array (SA-IS) and LCP array (Kasai) of a copy of [base, base+len) of the file
+ *  - occurrences of a pattern are a range of the suffix array, found by binary search in O(m log n)
+ *  - repeats: longest substrings occurring at least twice, one per group of occurrences
+ *  - built on a background thread, text, suffixes and LCP are spilled to a mapped file past SPILL_LEN
+ *  - state is the only field shared with the build thread, the others are valid once READY
+ */
+struct SearchSuffixArray
+{
+    std::atomic<i32> state{SearchIndexState::NONE};
+    std::atomic<bool> buildCancel{false};
+    struct SDL_Thread* buildThread = nullptr;
+
+    const FileSource* source = nullptr;
+    char spillPath[512] = {0};
+    i64 base = 0;
+    i32 len = 0;
+
+    Array<u8> textBuff;
+    Array<i32> saBuff;
+    Array<i32> lcpBuff; // lcp[i]: common prefix of suffixes sa[i-1] and sa[i], lcp[0] = 0
+    FileSource spill;
+    const u8* text = nullptr;
+    const i32* sa = nullptr;
+    const i32* lcp = nullptr;
+    Array<SearchRepeat> repeats; // longest first
+
+    ~SearchSuffixArray() { close(); }
+
+    // Builds the arrays of [start, start+size) on a background thread, source has to stay open until close()
+    bool build(const FileSource* source_, i64 start, i64 size, const char* spillPath_);
+    void close();
+
+    // Range [first, last) of the suffixes starting with pattern
+    void find(const u8* pattern, i32 patternLen, i32* first, i32* last) const;
+    // Sorted file offsets of the occurrences of pattern, at most maxCount. Returns the occurrence count
+    i64 occurrences(const u8* pattern, i32 patternLen, Array<i64>* offsets, i32 maxCount) const;
+
+    bool _spill();
+
+    inline bool isReady() const {
+        return state.load(std::memory_order_acquire) == SearchIndexState::READY;
+    }
+
+    inline bool isBuilding() const {
+        return state.load(std::memory_order_acquire) == SearchIndexState::BUILDING;
+    }
+};
+
+// Suffix array of s[0, n), sa holds n ints. Returns false if cancel was raised before the end
+bool searchSuffixSort(const u8* s, i32 n, i32* sa, const std::atomic<bool>* cancel = nullptr);
+// lcp[i] = common prefix of sa[i-1] and sa[i], temp holds n ints. Returns false if cancel was raised
+bool searchSuffixLcp(const u8* s, i32 n, const i32* sa, i32* lcp, i32* temp, const std::atomic<bool>* cancel = nullptr);
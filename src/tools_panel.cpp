@@ -3,8 +3,15 @@
 #include "bricks.h"
 #include "script.h"
 #include "search.h"
-
-void toolsDoInspectorWindow(const u8* fileBuffer, const i64 fileBufferSize, const SelectionState& selection)
+#include "search_kernel.h"
+#include "search_regex.h"
+#include "search_approx.h"
+#include "search_multi.h"
+#include "search_index.h"
+#include "search_suffix.h"
+#include "file_source.h"
+
+void toolsDoInspectorWindow(const FileSource& fileSource, const SelectionState& selection)
 {
 	// window begin
 	ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0.0f, 0.0f));
@@ -13,20 +20,27 @@ void toolsDoInspectorWindow(const u8* fileBuffer, const i64 fileBufferSize, cons
 
 	ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0, 0));
 
-	const u8* dataStart = &fileBuffer[MIN(selection.selectStart, selection.selectEnd)];
-	const u8* dataEnd = &fileBuffer[MAX(selection.selectStart, selection.selectEnd) + 1];
+	const i64 fileBufferSize = fileSource.size;
+	i64 inspectStart = MIN(selection.selectStart, selection.selectEnd);
+	i64 inspectEnd = MAX(selection.selectStart, selection.selectEnd) + 1;
 
     if(selection.selectStart < 0) {
         if(selection.hoverStart >= 0) {
-			dataStart = &fileBuffer[MIN(selection.hoverStart, selection.hoverEnd)];
-			dataEnd = &fileBuffer[MAX(selection.hoverStart, selection.hoverEnd)];
+			inspectStart = MIN(selection.hoverStart, selection.hoverEnd);
+			inspectEnd = MAX(selection.hoverStart, selection.hoverEnd);
         }
         else {
-            dataStart = 0;
-            dataEnd = 0;
+            inspectStart = 0;
+            inspectEnd = 0;
         }
     }
 
+	// only the first bytes are ever displayed
+	u8 inspectData[64] = {0};
+	const i64 inspectSize = fileSource.read(inspectStart, inspectData, MIN(inspectEnd - inspectStart, (i64)sizeof(inspectData)));
+	const u8* dataStart = inspectData;
+	const u8* dataEnd = inspectData + inspectSize;
+
 	const f32 tableLineHeight = 24;
 
 	u32 typeFrameColor = 0xffeeeeee;
@@ -145,7 +159,7 @@ void toolsDoInspectorWindow(const u8* fileBuffer, const i64 fileBufferSize, cons
 	ImGui::TextBox(typeFrameColor, typeTextColor, cellSize, align, textOffset, "File offset 64");
 	ImGui::NextColumn();
 	u64 offset64 = *(u64*)&dataInt;
-	ImGui::TextBox(frameColor, offset < fileBufferSize ? green : red, cellSize, align,
+	ImGui::TextBox(frameColor, offset64 < (u64)fileBufferSize ? green : red, cellSize, align,
 				   textOffset, "%#llx", offset64);
 	ImGui::NextColumn();
 
@@ -217,13 +231,15 @@ void toolsDoTemplate(BrickWall* brickWall)
     //ui_brickStructList(brickWall);
 }
 
-void toolsDoOptions(i32* pColumnCount, i32* pOutOffset)
+void toolsDoOptions(i32* pColumnCount, i64* pOutOffset)
 {
 	ImGui::SliderInt("Columns", pColumnCount, 8, 64);
 	*pColumnCount = clamp(*pColumnCount, 8, 64);
 
-	ImGui::SliderInt("File Offset", pOutOffset, 0, 32);
-	*pOutOffset = clamp(*pOutOffset, 0, 32);
+	const i64 offsetMin = 0;
+	const i64 offsetMax = 32;
+	ImGui::SliderScalar("File Offset", ImGuiDataType_S64, pOutOffset, &offsetMin, &offsetMax, "%lld");
+	*pOutOffset = clamp(*pOutOffset, offsetMin, offsetMax);
 }
 
 void toolsDoScript(Script* script, BrickWall* brickWall)
@@ -235,9 +251,11 @@ void toolsDoScript(Script* script, BrickWall* brickWall)
     }
 }
 
-bool toolsSearchParams(SearchParams* params)
+bool toolsSearchParams(SearchParams* params, SearchOutput* output, const BrickWall& brickWall)
 {
 	bool doSearch = false;
+	// plain copy, compared below to catch any edit
+	const SearchParams paramsBefore = *params;
 
 	ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(10, 10));
 
@@ -245,6 +263,11 @@ bool toolsSearchParams(SearchParams* params)
 		"ASCII String",
 		"Integer",
 		"Float",
+		"Multi pattern",
+		"Masked pattern",
+		"Regex",
+		"Relative",
+		"Approximate",
 	};
 
 	ImGui::ButtonListOne("##comboDataType", dataTypeComboItems, arr_count(dataTypeComboItems),
@@ -254,7 +277,25 @@ bool toolsSearchParams(SearchParams* params)
 		case SearchDataType::ASCII_String: {
 			ImGui::Text("String:");
 			ImGui::InputText("##searchString", params->str, sizeof(params->str));
-			params->dataSize = strlen(params->str);
+
+			static i32 encodingId = 0;
+			const char* encodingList[] = {
+				"UTF-8",
+				"UTF-16 LE",
+				"UTF-16 BE",
+			};
+			ImGui::ButtonListOne("encoding_select", encodingList, arr_count(encodingList),
+								 &encodingId, ImVec2(200, 0));
+
+			static bool caseInsensitive = false;
+			ImGui::Checkbox("Case insensitive", &caseInsensitive);
+
+			params->encoding = (SearchParams::Encoding)encodingId;
+			params->caseInsensitive = caseInsensitive;
+
+			u8 data[SEARCH_NEEDLE_MAX_LEN];
+			u8 mask[SEARCH_NEEDLE_MAX_LEN];
+			params->dataSize = searchEncodeString(*params, data, mask, SEARCH_NEEDLE_MAX_LEN);
 			params->strideKind = SearchParams::Stride::Full;
 		} break;
 
@@ -285,6 +326,10 @@ bool toolsSearchParams(SearchParams* params)
 
 			static bool signed_ = true;
 			ImGui::Checkbox("Signed", &signed_);
+			ImGui::SameLine();
+			static bool bigEndian = false;
+			ImGui::Checkbox("Big endian", &bigEndian);
+			params->bigEndian = bigEndian;
 
 			ImGui::Text("Integer:");
 			const i32 step = 1;
@@ -301,9 +346,35 @@ bool toolsSearchParams(SearchParams* params)
 
 			params->dataSize = 1 << bitSizeItemId;
 			params->strideKind = (SearchParams::Stride)searchStrideId;
+			params->intSigned = signed_;
 
-			ImGui::InputScalar("##int_input", intType, searchInt, &step,
-							   &stepFast, format);
+			static i32 compareId = 0;
+			const char* compareList[] = {
+				"Equal",
+				"Range",
+			};
+			ImGui::ButtonListOne("int_compare_select", compareList, arr_count(compareList),
+								 &compareId, ImVec2(200, 0));
+			params->compare = (SearchParams::Compare)compareId;
+
+			if(params->compare == SearchParams::Range) {
+				// min and max are always 64bit, they get clamped to the integer size
+				const i64 step64 = 1;
+				const i64 stepFast64 = 100;
+				ImGui::Text("Min / Max:");
+				if(signed_) {
+					ImGui::InputScalar("##int_min", ImGuiDataType_S64, &params->vintMin, &step64, &stepFast64, "%lld");
+					ImGui::InputScalar("##int_max", ImGuiDataType_S64, &params->vintMax, &step64, &stepFast64, "%lld");
+				}
+				else {
+					ImGui::InputScalar("##int_min", ImGuiDataType_U64, &params->vuintMin, &step64, &stepFast64, "%llu");
+					ImGui::InputScalar("##int_max", ImGuiDataType_U64, &params->vuintMax, &step64, &stepFast64, "%llu");
+				}
+			}
+			else {
+				ImGui::InputScalar("##int_input", intType, searchInt, &step,
+								   &stepFast, format);
+			}
 		} break;
 
 		case SearchDataType::Float: {
@@ -329,25 +400,256 @@ bool toolsSearchParams(SearchParams* params)
 			ImGui::ButtonListOne("stride_select", strideSelectList, arr_count(strideSelectList),
 								 &searchStrideId, ImVec2(200, 0));
 
+			static bool bigEndian = false;
+			ImGui::Checkbox("Big endian", &bigEndian);
+			params->bigEndian = bigEndian;
+
 			ImGui::Text("Float:");
 
 			const f64 step = 1;
 			const f64 stepFast = 10;
 			ImGuiDataType_ fltType = bitSizeItemId == 0 ? ImGuiDataType_Float: ImGuiDataType_Double;
 			const char* format = bitSizeItemId == 0 ? "%.5f": "%.10f";
-			void* fltVal = bitSizeItemId == 0 ? &params->vf32: &params->vf64;
+			void* fltVal = bitSizeItemId == 0 ? (void*)&params->vf32: (void*)&params->vf64;
 
 			params->dataSize = bitSizeItemId == 0 ? 4 : 8;
 			params->strideKind = (SearchParams::Stride)searchStrideId;
 
-			ImGui::InputScalar("##flt_input", fltType, fltVal, &step,
-							   &stepFast, format);
+			static i32 compareId = 0;
+			const char* compareList[] = {
+				"Equal",
+				"Range",
+				"Tolerance",
+				"ULP",
+				"NaN/Inf",
+			};
+			ImGui::ButtonListOne("flt_compare_select", compareList, arr_count(compareList),
+								 &compareId, ImVec2(100, 0));
+			params->compare = (SearchParams::Compare)compareId;
+
+			switch(params->compare) {
+				case SearchParams::Range: {
+					ImGui::Text("Min / Max:");
+					ImGui::InputScalar("##flt_min", ImGuiDataType_Double, &params->vfMin, &step, &stepFast,
+									   "%.10g");
+					ImGui::InputScalar("##flt_max", ImGuiDataType_Double, &params->vfMax, &step, &stepFast,
+									   "%.10g");
+				} break;
+
+				case SearchParams::Tolerance: {
+					ImGui::InputScalar("##flt_input", fltType, fltVal, &step,
+									   &stepFast, format);
+					ImGui::Text("Epsilon:");
+					ImGui::InputScalar("##flt_eps", ImGuiDataType_Double, &params->vfEps, nullptr, nullptr, "%g");
+				} break;
+
+				case SearchParams::Ulp: {
+					ImGui::InputScalar("##flt_input", fltType, fltVal, &step,
+									   &stepFast, format);
+					ImGui::Text("Max ULP distance:");
+					const i64 ulpStep = 1;
+					ImGui::InputScalar("##flt_ulps", ImGuiDataType_S64, &params->ulps, &ulpStep, nullptr, "%lld");
+				} break;
+
+				case SearchParams::NonFinite: break;
+
+				default: {
+					ImGui::InputScalar("##flt_input", fltType, fltVal, &step,
+									   &stepFast, format);
+				} break;
+			}
+		} break;
+
+		case SearchDataType::Multi_Pattern: {
+			ImGui::Text("Patterns (one per line, hex bytes or \"string\"):");
+			ImGui::InputTextMultiline("##searchPatterns", params->patterns, sizeof(params->patterns),
+									  ImVec2(-1, ImGui::GetTextLineHeight() * 10));
+			params->dataSize = 0;
+			params->strideKind = SearchParams::Stride::Full;
+		} break;
+
+		case SearchDataType::Masked_Pattern: {
+			ImGui::Text("Pattern (?? any byte, ?0 nibble, 40/F0 bit mask):");
+			ImGui::InputText("##searchMasked", params->maskedPattern, sizeof(params->maskedPattern));
+
+			u8 data[SEARCH_NEEDLE_MAX_LEN];
+			u8 mask[SEARCH_NEEDLE_MAX_LEN];
+			params->dataSize = searchParseMaskedPattern(params->maskedPattern, data, mask, SEARCH_NEEDLE_MAX_LEN);
+			params->strideKind = SearchParams::Stride::Full;
+
+			if(params->dataSize == 0) {
+				ImGui::TextColored(ImVec4(0.8f, 0, 0, 1), "Invalid pattern");
+			}
+		} break;
+
+		case SearchDataType::Regex: {
+			static SearchRegex regex;
+			static char regexError[128] = {0};
+			static bool regexValid = false;
+			static bool regexCompiled = false;
+
+			ImGui::Text("Byte regex (\\xNN, [classes], * + ? {n,m}, |):");
+			const bool changed = ImGui::InputText("##searchRegex", params->regex, sizeof(params->regex));
+
+			// only recompile on edit
+			if(changed || !regexCompiled) {
+				regexValid = regex.compile(params->regex, regexError, sizeof(regexError));
+				regexCompiled = true;
+			}
+			params->dataSize = regexValid ? 1 : 0;
+			params->strideKind = SearchParams::Stride::Full;
+
+			if(!regexValid && params->regex[0]) {
+				ImGui::TextColored(ImVec4(0.8f, 0, 0, 1), "%s", regexError);
+			}
+		} break;
+
+		case SearchDataType::Relative: {
+			static i32 elemSizeId = 0;
+			static i32 searchStrideId = 0;
+
+			ImGui::Text("Word (same differences between letters):");
+			ImGui::InputText("##searchRelative", params->relativeWord, sizeof(params->relativeWord));
+
+			ImGui::Text("Value size (in bits):");
+			const char* elemSizeList[] = {
+				"8",
+				"16",
+			};
+			ImGui::ButtonListOne("relative_size_select", elemSizeList, arr_count(elemSizeList),
+								 &elemSizeId, ImVec2(100, 0));
+			params->relativeElemSize = elemSizeId == 0 ? 1 : 2;
+
+			// 16bit values can be searched at any byte or aligned
+			params->strideKind = SearchParams::Stride::Full;
+			if(elemSizeId == 1) {
+				ImGui::Text("Search stride:");
+				const char* strideSelectList[] = {
+					"Full",
+					"Even",
+				};
+				ImGui::ButtonListOne("stride_select", strideSelectList, arr_count(strideSelectList),
+									 &searchStrideId, ImVec2(100, 0));
+				if(searchStrideId == 1) {
+					params->strideKind = SearchParams::Stride::Even;
+				}
+			}
+
+			const i32 wordLen = MIN((i32)strlen(params->relativeWord), SEARCH_NEEDLE_MAX_LEN / 2);
+			params->dataSize = wordLen >= 2 ? wordLen * params->relativeElemSize : 0;
+
+			if(params->relativeWord[0] && wordLen < 2) {
+				ImGui::TextColored(ImVec4(0.8f, 0, 0, 1), "At least 2 characters");
+			}
+		} break;
+
+		case SearchDataType::Approximate: {
+			ImGui::Text("Pattern (hex bytes or \"string\", %d bytes max):", SEARCH_APPROX_MAX_LEN);
+			ImGui::InputText("##searchApprox", params->approxPattern, sizeof(params->approxPattern));
+
+			ImGui::Text("Max errors:");
+			ImGui::InputInt("##approx_errors", &params->approxMaxErrors);
+			params->approxMaxErrors = clamp(params->approxMaxErrors, 0, SEARCH_APPROX_MAX_ERRORS);
+
+			static bool edits = false;
+			ImGui::Checkbox("Insertions / deletions", &edits);
+			params->approxEdits = edits;
+
+			SearchPattern pattern;
+			const i32 patternCount = searchParsePatterns(params->approxPattern, &pattern, 1);
+			params->dataSize = patternCount > 0 ? pattern.len : 0;
+			params->strideKind = SearchParams::Stride::Full;
+
+			if(params->approxPattern[0] && params->dataSize == 0) {
+				ImGui::TextColored(ImVec4(0.8f, 0, 0, 1), "Invalid pattern");
+			}
+			else if(params->dataSize > 0 && params->approxMaxErrors >= params->dataSize) {
+				ImGui::TextColored(ImVec4(0.8f, 0, 0, 1), "At most %d errors for this pattern",
+								   params->dataSize - 1);
+			}
 		} break;
 
 		default: assert(0); break;
 	}
 
-	if(ImGui::Button("Search", ImVec2(120,0))) {
+	ImGui::Text("Search in:");
+	const char* scopeList[] = {
+		"File",
+		"Selection",
+		"Window",
+		"Brick field",
+	};
+	ImGui::ButtonListOne("scope_select", scopeList, arr_count(scopeList), (i32*)&params->scope, ImVec2(100, 0));
+
+	switch(params->scope) {
+		case SearchParams::Window: {
+			ImGui::Text("Start / End (hex, end excluded):");
+			ImGui::InputScalar("##window_start", ImGuiDataType_S64, &params->windowStart, nullptr, nullptr, "%llX",
+							   ImGuiInputTextFlags_CharsHexadecimal);
+			ImGui::InputScalar("##window_end", ImGuiDataType_S64, &params->windowEnd, nullptr, nullptr, "%llX",
+							   ImGuiInputTextFlags_CharsHexadecimal);
+			params->windowStart = MAX(params->windowStart, 0);
+		} break;
+
+		case SearchParams::BrickField: {
+			const char* preview = "";
+			if(params->fieldStructId >= 0 && params->fieldStructId < brickWall.structs.count() &&
+			   params->fieldId >= 0 && params->fieldId < brickWall.structs[params->fieldStructId].bricks.count()) {
+				preview = brickWall.structs[params->fieldStructId].bricks[params->fieldId].name.str;
+			}
+
+			if(ImGui::BeginCombo("##search_field", preview)) {
+				for(i32 s = 0; s < brickWall.structs.count(); s++) {
+					const BrickStruct& bstruct = brickWall.structs[s];
+					for(i32 f = 0; f < bstruct.bricks.count(); f++) {
+						char label[160];
+						snprintf(label, sizeof(label), "%s.%s##%d_%d", bstruct.name.str, bstruct.bricks[f].name.str,
+								 s, f);
+						const bool selected = s == params->fieldStructId && f == params->fieldId;
+						if(ImGui::Selectable(label, selected)) {
+							params->fieldStructId = s;
+							params->fieldId = f;
+						}
+					}
+				}
+				ImGui::EndCombo();
+			}
+		} break;
+
+		default: break;
+	}
+
+	ImGui::Text("Results:");
+	const char* outputList[] = {
+		"List",
+		"Count only",
+		"Export",
+	};
+	ImGui::ButtonListOne("output_select", outputList, arr_count(outputList), (i32*)&output->kind, ImVec2(100, 0));
+
+	if(output->kind == SearchOutput::Stream) {
+		const char* formatList[] = {
+			"Binary",
+			"CSV",
+		};
+		ImGui::ButtonListOne("output_format_select", formatList, arr_count(formatList), (i32*)&output->format,
+							 ImVec2(100, 0));
+		ImGui::InputText("File##output_path", output->path, sizeof(output->path));
+	}
+
+	const bool canSearch = (params->dataType == SearchDataType::Multi_Pattern || params->dataSize > 0) &&
+						   (output->kind != SearchOutput::Stream || output->path[0]);
+	if(ImGui::Button("Search", ImVec2(120,0)) && canSearch) {
+		doSearch = true;
+	}
+
+	// narrower queries (one more character, a smaller range) only filter the previous results
+	static bool searchAsYouType = true;
+	ImGui::SameLine();
+	ImGui::Checkbox("Search as you type", &searchAsYouType);
+	// exports are only written on demand
+	if(searchAsYouType && canSearch && output->kind != SearchOutput::Stream &&
+	   memcmp(&paramsBefore, params, sizeof(SearchParams)) != 0) {
 		doSearch = true;
 	}
 
@@ -355,65 +657,324 @@ bool toolsSearchParams(SearchParams* params)
 	return doSearch;
 }
 
-bool toolsSearchResults(const SearchParams& params, const ArrayTS<SearchResult>& results, u64* gotoOffset)
+bool toolsSearchRanges(const SearchParams& params, const SelectionState& selection, const BrickWall& brickWall,
+					   Array<SearchRange>* ranges)
+{
+	ranges->clear();
+
+	switch(params.scope) {
+		case SearchParams::Selection: {
+			// an empty selection finds nothing
+			if(!selection.isEmpty()) {
+				const i64 selMin = MIN(selection.selectStart, selection.selectEnd);
+				const i64 selMax = MAX(selection.selectStart, selection.selectEnd);
+				ranges->push({ selMin, selMax + 1 });
+			}
+		} break;
+
+		case SearchParams::Window: {
+			ranges->push({ params.windowStart, params.windowEnd });
+		} break;
+
+		case SearchParams::BrickField: {
+			Array<i64> starts;
+			brickWall.findFieldInstances(params.fieldStructId, params.fieldId, &starts);
+			if(starts.count() > 0) {
+				const i64 fieldSize = brickWall.structs[params.fieldStructId].bricks[params.fieldId].size;
+				ranges->reserve(starts.count());
+				for(i64 start: starts) {
+					ranges->push({ start, start + fieldSize });
+				}
+			}
+		} break;
+
+		default: return false;
+	}
+	return true;
+}
+
+void toolsSearchIndex(SearchIndex* index)
+{
+	if(index->isBuilding()) {
+		char progressStr[64];
+		snprintf(progressStr, sizeof(progressStr), "Indexing %.0f%%", index->buildProgress() * 100.0f);
+		ImGui::ProgressBar(index->buildProgress(), ImVec2(200, 0), progressStr);
+		ImGui::SameLine();
+		if(ImGui::Button("Cancel##index")) {
+			index->cancelBuild();
+		}
+	}
+	else if(index->isReady()) {
+		// patterns with 4 known bytes in a row skip the blocks where they can't be
+		ImGui::TextDisabled("Index ready (%.1f MB)", (f64)index->indexFile.size / (1024 * 1024));
+	}
+	else if(index->source) {
+		// the index is only worth it on files searched again and again
+		if(ImGui::Button("Build index")) {
+			index->build();
+		}
+	}
+}
+
+bool toolsSuffixArray(SearchSuffixArray* sfx, const FileSource& fileSource, const SelectionState& selection,
+					  const char* spillPath, i64* gotoOffset, i32* gotoLen)
+{
+	if(!ImGui::CollapsingHeader("Suffix array")) {
+		return false;
+	}
+
+	if(sfx->isBuilding()) {
+		ImGui::TextDisabled("Sorting %d bytes...", sfx->len);
+		return false;
+	}
+
+	if(!sfx->isReady()) {
+		if(!fileSource.isOpen() || fileSource.available() < fileSource.size) {
+			return false;
+		}
+		if(fileSource.size <= SEARCH_SUFFIX_MAX_LEN && ImGui::Button("Build (file)")) {
+			sfx->build(&fileSource, 0, fileSource.size, spillPath);
+		}
+		if(!selection.isEmpty()) {
+			const i64 selMin = MIN(selection.selectStart, selection.selectEnd);
+			const i64 selMax = MAX(selection.selectStart, selection.selectEnd);
+			if(fileSource.size <= SEARCH_SUFFIX_MAX_LEN) {
+				ImGui::SameLine();
+			}
+			if(selMax - selMin + 1 <= SEARCH_SUFFIX_MAX_LEN && ImGui::Button("Build (selection)")) {
+				sfx->build(&fileSource, selMin, selMax - selMin + 1, spillPath);
+			}
+		}
+		ImGui::TextDisabled("Up to %d MB", SEARCH_SUFFIX_MAX_LEN / (1024 * 1024));
+		return false;
+	}
+
+	ImGui::Text("%llx - %llx (%d bytes)", sfx->base, sfx->base + sfx->len, sfx->len);
+	ImGui::SameLine();
+	if(ImGui::Button("Release")) {
+		sfx->close();
+		return false;
+	}
+
+	// the occurrences are only looked up again when the query or the array changes
+	static char query[256];
+	static char lastQuery[256];
+	static const i32* lastSa = nullptr;
+	static Array<i64> offsets;
+	static i64 occurrenceCount = 0;
+	static i32 queryLen = 0;
+	ImGui::InputText("Occurs (hex or \"string\")", query, sizeof(query));
+	if(strcmp(query, lastQuery) != 0 || lastSa != sfx->sa) {
+		memmove(lastQuery, query, sizeof(query));
+		lastSa = sfx->sa;
+		SearchPattern pattern;
+		queryLen = searchParsePatterns(query, &pattern, 1) == 1 ? pattern.len : 0;
+		occurrenceCount = sfx->occurrences(pattern.data, queryLen, &offsets, 1000);
+	}
+
+	bool clicked = false;
+	ImGui::Text("%lld occurrences", occurrenceCount);
+	if(offsets.count() > 0) {
+		ImGui::BeginChild("suffix_occurrences", ImVec2(0, 100), true);
+		for(i32 i = 0; i < offsets.count(); i++) {
+			char label[64];
+			snprintf(label, sizeof(label), "%llx##occ%d", offsets[i], i);
+			if(ImGui::Selectable(label)) {
+				*gotoOffset = offsets[i];
+				*gotoLen = queryLen;
+				clicked = true;
+			}
+		}
+		ImGui::EndChild();
+	}
+
+	ImGui::Text("Longest repeats");
+	ImGui::BeginChild("suffix_repeats", ImVec2(0, 150), true);
+	for(i32 r = 0; r < sfx->repeats.count(); r++) {
+		const SearchRepeat& repeat = sfx->repeats[r];
+		char preview[17];
+		const i32 previewLen = MIN(repeat.len, 16);
+		for(i32 i = 0; i < previewLen; i++) {
+			const u8 c = sfx->text[repeat.offset - sfx->base + i];
+			preview[i] = c >= 0x20 && c < 0x7F ? c : '.';
+		}
+		preview[previewLen] = 0;
+
+		char label[128];
+		snprintf(label, sizeof(label), "%llx  %d bytes  x%d  %s##rep%d", repeat.offset, repeat.len, repeat.count,
+				 preview, r);
+		if(ImGui::Selectable(label)) {
+			*gotoOffset = repeat.offset;
+			*gotoLen = repeat.len;
+			clicked = true;
+		}
+	}
+	ImGui::EndChild();
+	return clicked;
+}
+
+bool toolsSearchResults(const SearchParams& params, const SearchOutput& output, const SearchResultList& results,
+						i64* gotoOffset, i32* gotoLen)
 {
 	ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0, 0));
 
 	switch(params.dataType) {
 		case SearchDataType::ASCII_String: {
-			const f32 typeFrameLen = ImGui::CalcTextSize("ASCII").x + 20.0f;
+			const char* encodingNames[] = { "ASCII", "UTF-16 LE", "UTF-16 BE" };
+			const char* typeName = encodingNames[params.encoding];
+			const f32 typeFrameLen = ImGui::CalcTextSize(typeName).x + 20.0f;
 			const f32 searchTermFrameLen = ImGui::GetContentRegionAvail().x - typeFrameLen;
 
 			ImGui::TextBox(0xffdfdfdf, 0xff000000, ImVec2(typeFrameLen, 35), ImVec2(0.5, 0.5), ImVec2(0, 0),
-						   "ASCII");
+						   "%s", typeName);
 			ImGui::SameLine();
 			ImGui::TextBox(0xffffefef, 0xffff0000, ImVec2(searchTermFrameLen, 35),
 						   ImVec2(0, 0.5), ImVec2(10, 0),
-						   "%.*s", params.dataSize, params.str);
+						   "%s%s", params.str, params.caseInsensitive ? "  (case insensitive)" : "");
 		} break;
 
 		case SearchDataType::Integer: {
 			if(params.intSigned) {
-				const f32 typeFrameLen = ImGui::CalcTextSize("Integer").x + 20.0f;
+				const char* typeName = params.bigEndian ? "Integer BE" : "Integer";
+				const f32 typeFrameLen = ImGui::CalcTextSize(typeName).x + 20.0f;
 				const f32 searchTermFrameLen = ImGui::GetContentRegionAvail().x - typeFrameLen;
 
 				ImGui::TextBox(0xffdfdfdf, 0xff000000, ImVec2(typeFrameLen, 35), ImVec2(0.5, 0.5),
-							   ImVec2(0, 0), "Integer");
+							   ImVec2(0, 0), "%s", typeName);
 				ImGui::SameLine();
-				ImGui::TextBox(0xffffefef, 0xffff0000, ImVec2(searchTermFrameLen, 35), ImVec2(0, 0.5),
-							   ImVec2(10, 0),
-							   "%d", params.vint);
+				if(params.compare == SearchParams::Range) {
+					ImGui::TextBox(0xffffefef, 0xffff0000, ImVec2(searchTermFrameLen, 35), ImVec2(0, 0.5),
+								   ImVec2(10, 0),
+								   "[%lld, %lld]", params.vintMin, params.vintMax);
+				}
+				else {
+					ImGui::TextBox(0xffffefef, 0xffff0000, ImVec2(searchTermFrameLen, 35), ImVec2(0, 0.5),
+								   ImVec2(10, 0),
+								   "%d", params.vint);
+				}
 			}
 			else {
-				const f32 typeFrameLen = ImGui::CalcTextSize("Unsigned integer").x + 20.0f;
+				const char* typeName = params.bigEndian ? "Unsigned integer BE" : "Unsigned integer";
+				const f32 typeFrameLen = ImGui::CalcTextSize(typeName).x + 20.0f;
 				const f32 searchTermFrameLen = ImGui::GetContentRegionAvail().x - typeFrameLen;
 
 				ImGui::TextBox(0xffdfdfdf, 0xff000000, ImVec2(typeFrameLen, 35), ImVec2(0.5, 0.5),
-							   ImVec2(0, 0), "Unsigned integer");
+							   ImVec2(0, 0), "%s", typeName);
 				ImGui::SameLine();
-				ImGui::TextBox(0xffffefef, 0xffff0000, ImVec2(searchTermFrameLen, 35),
-							   ImVec2(0, 0.5), ImVec2(10, 0),
-							   "%llu", params.vuint);
+				if(params.compare == SearchParams::Range) {
+					ImGui::TextBox(0xffffefef, 0xffff0000, ImVec2(searchTermFrameLen, 35),
+								   ImVec2(0, 0.5), ImVec2(10, 0),
+								   "[%llu, %llu]", params.vuintMin, params.vuintMax);
+				}
+				else {
+					ImGui::TextBox(0xffffefef, 0xffff0000, ImVec2(searchTermFrameLen, 35),
+								   ImVec2(0, 0.5), ImVec2(10, 0),
+								   "%llu", params.vuint);
+				}
 			}
 		} break;
 
 		case SearchDataType::Float: {
-			const f32 typeFrameLen = ImGui::CalcTextSize("Float").x + 20.0f;
+			const char* typeName = params.bigEndian ? "Float BE" : "Float";
+			const f32 typeFrameLen = ImGui::CalcTextSize(typeName).x + 20.0f;
 			const f32 searchTermFrameLen = ImGui::GetContentRegionAvail().x - typeFrameLen;
 
 			ImGui::TextBox(0xffdfdfdf, 0xff000000, ImVec2(typeFrameLen, 35), ImVec2(0.5, 0.5), ImVec2(0, 0),
-						   "Float");
+						   "%s", typeName);
 			ImGui::SameLine();
+			const f64 value = params.dataSize == 4 ? params.vf32 : params.vf64;
+			char term[128];
+			switch(params.compare) {
+				case SearchParams::Range: snprintf(term, sizeof(term), "[%g, %g]", params.vfMin, params.vfMax); break;
+				case SearchParams::Tolerance: snprintf(term, sizeof(term), "%g +- %g", value, params.vfEps); break;
+				case SearchParams::Ulp: snprintf(term, sizeof(term), "%g +- %lld ulp", value, params.ulps); break;
+				case SearchParams::NonFinite: snprintf(term, sizeof(term), "NaN / Inf"); break;
+				default: snprintf(term, sizeof(term), "%g", value); break;
+			}
+
 			ImGui::TextBox(0xffffefef, 0xffff0000, ImVec2(searchTermFrameLen, 35), ImVec2(0, 0.5),
 						   ImVec2(10, 0),
-						   "%g", params.dataSize == 4 ? params.vf32 : params.vf64);
+						   "%s", term);
+		} break;
+
+		case SearchDataType::Masked_Pattern: {
+			const f32 typeFrameLen = ImGui::CalcTextSize("Masked").x + 20.0f;
+			const f32 searchTermFrameLen = ImGui::GetContentRegionAvail().x - typeFrameLen;
+
+			ImGui::TextBox(0xffdfdfdf, 0xff000000, ImVec2(typeFrameLen, 35), ImVec2(0.5, 0.5), ImVec2(0, 0),
+						   "Masked");
+			ImGui::SameLine();
+			ImGui::TextBox(0xffffefef, 0xffff0000, ImVec2(searchTermFrameLen, 35), ImVec2(0, 0.5),
+						   ImVec2(10, 0),
+						   "%s", params.maskedPattern);
+		} break;
+
+		case SearchDataType::Regex: {
+			const f32 typeFrameLen = ImGui::CalcTextSize("Regex").x + 20.0f;
+			const f32 searchTermFrameLen = ImGui::GetContentRegionAvail().x - typeFrameLen;
+
+			ImGui::TextBox(0xffdfdfdf, 0xff000000, ImVec2(typeFrameLen, 35), ImVec2(0.5, 0.5), ImVec2(0, 0),
+						   "Regex");
+			ImGui::SameLine();
+			ImGui::TextBox(0xffffefef, 0xffff0000, ImVec2(searchTermFrameLen, 35), ImVec2(0, 0.5),
+						   ImVec2(10, 0),
+						   "%s", params.regex);
+		} break;
+
+		case SearchDataType::Relative: {
+			const char* typeName = params.relativeElemSize == 2 ? "Relative 16" : "Relative";
+			const f32 typeFrameLen = ImGui::CalcTextSize(typeName).x + 20.0f;
+			const f32 searchTermFrameLen = ImGui::GetContentRegionAvail().x - typeFrameLen;
+
+			ImGui::TextBox(0xffdfdfdf, 0xff000000, ImVec2(typeFrameLen, 35), ImVec2(0.5, 0.5), ImVec2(0, 0),
+						   "%s", typeName);
+			ImGui::SameLine();
+			ImGui::TextBox(0xffffefef, 0xffff0000, ImVec2(searchTermFrameLen, 35), ImVec2(0, 0.5),
+						   ImVec2(10, 0),
+						   "%s", params.relativeWord);
+		} break;
+
+		case SearchDataType::Approximate: {
+			const char* typeName = params.approxEdits ? "Edit distance" : "Hamming";
+			const f32 typeFrameLen = ImGui::CalcTextSize(typeName).x + 20.0f;
+			const f32 searchTermFrameLen = ImGui::GetContentRegionAvail().x - typeFrameLen;
+
+			ImGui::TextBox(0xffdfdfdf, 0xff000000, ImVec2(typeFrameLen, 35), ImVec2(0.5, 0.5), ImVec2(0, 0),
+						   "%s", typeName);
+			ImGui::SameLine();
+			ImGui::TextBox(0xffffefef, 0xffff0000, ImVec2(searchTermFrameLen, 35), ImVec2(0, 0.5),
+						   ImVec2(10, 0),
+						   "%s  (<= %d errors)", params.approxPattern, params.approxMaxErrors);
+		} break;
+
+		case SearchDataType::Multi_Pattern: {
+			const f32 typeFrameLen = ImGui::CalcTextSize("Multi pattern").x + 20.0f;
+			const f32 searchTermFrameLen = ImGui::GetContentRegionAvail().x - typeFrameLen;
+
+			ImGui::TextBox(0xffdfdfdf, 0xff000000, ImVec2(typeFrameLen, 35), ImVec2(0.5, 0.5), ImVec2(0, 0),
+						   "Multi pattern");
+			ImGui::SameLine();
+			ImGui::TextBox(0xffffefef, 0xffff0000, ImVec2(searchTermFrameLen, 35), ImVec2(0, 0.5),
+						   ImVec2(10, 0),
+						   "%d patterns", results.patternLens.count());
 		} break;
 	}
 
+	const char* scopeNames[] = { "", " in selection", " in window", " in brick field" };
+	if(output.kind != SearchOutput::List) {
+		// nothing to list
+		ImGui::TextBox(0xffffffff, 0xff000000, ImVec2(0, 30), ImVec2(0, 0.5), ImVec2(10, 0),
+					   "%lld found%s%s%s", searchFoundCount(), scopeNames[params.scope],
+					   output.kind == SearchOutput::Stream ? ", written to " : "",
+					   output.kind == SearchOutput::Stream ? output.path : "");
+		ImGui::PopStyleVar(1); // ItemSpacing
+		return false;
+	}
+
 	ImGui::TextBox(0xffffffff, 0xff000000, ImVec2(0, 30), ImVec2(0, 0.5), ImVec2(10, 0),
-				   "%d found", results.count());
+				   "%lld found%s", results.count(), scopeNames[params.scope]);
 
-	const i32 count = results.count();
+	const i64 count = results.count();
 	if(count <= 0) {
 		ImGui::PopStyleVar(1); // ItemSpacing
 		return false;
@@ -422,28 +983,43 @@ bool toolsSearchResults(const SearchParams& params, const ArrayTS<SearchResult>&
 	bool clicked = false;
 
 	ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0, 0));
-	ImGui::BeginChild("search_results", {0,0}, false, ImGuiWindowFlags_AlwaysUseWindowPadding);
+	// vertical scrolling is virtual like the hex view (see DoScrollbarVertical), float pixel positions
+	// can't address every row of a hundred million results
+	ImGui::BeginChild("search_results", {0,0}, false, ImGuiWindowFlags_AlwaysUseWindowPadding|
+					  ImGuiWindowFlags_NoScrollbar|ImGuiWindowFlags_NoScrollWithMouse);
 
 	ImGuiWindow* window = ImGui::GetCurrentWindow();
 	const ImVec2 padding = {12, 3};
 	const ImVec2 textSize = ImGui::CalcTextSize("AAAAAAAAAAA");
-	ImGuiListClipper clipper(count, textSize.y + padding.y * 2);
-
-	for(i32 i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
-		const u64 itemDataOffset = results[i].offset;
+	const f32 rowHeight = textSize.y + padding.y * 2;
+	const i64 pageRowCount = MAX((i64)(window->Rect().GetHeight() / rowHeight), (i64)1);
+	const f32 rowWidth = ImGui::GetContentRegionAvail().x - (count > pageRowCount ? ImGui::GetStyle().ScrollbarSize : 0);
+
+	static i64 topRow = 0;
+	topRow = clamp(topRow, (i64)0, MAX(count - pageRowCount, (i64)0));
+
+	// one more row, partly visible at the bottom
+	const i64 rowEnd = MIN(topRow + pageRowCount + 1, count);
+	for(i64 i = topRow; i < rowEnd; i++) {
+		const SearchResult item = results.get(i);
+		const i64 itemDataOffset = item.offset;
 		const ImVec2 pos = window->DC.CursorPos;
-		const ImVec2 size = {ImGui::GetContentRegionAvail().x, textSize.y + padding.y * 2};
+		const ImVec2 size = {rowWidth, rowHeight};
 		const ImRect frameBb = {pos, pos + size};
 		bool hovered, held;
 		ImGui::ButtonBehavior(frameBb, window->GetID(((u8*)&results) + i), &hovered, &held);
 
 		u32 textColor = 0xff000000;
 		u32 frameColor = (i&1) ? 0xfff0f0f0 : 0xffe0e0e0;
+		if(results.isMultiPattern()) {
+			frameColor = searchPatternColor(item.patternId);
+		}
 
 		if(held) {
 			frameColor = 0xffff7200;
 			textColor = 0xffffffff;
 			*gotoOffset = itemDataOffset;
+			*gotoLen = item.len;
 		}
 		else if(hovered) {
 			frameColor = 0xffffb056;
@@ -451,15 +1027,25 @@ bool toolsSearchResults(const SearchParams& params, const ArrayTS<SearchResult>&
 		}
 		clicked |= held;
 
-		ImGui::TextBox(frameColor, textColor, size,
-					   ImVec2(0, 0.5), ImVec2(padding.x, 0),
-					   "%llx", itemDataOffset);
+		if(results.isMultiPattern()) {
+			ImGui::TextBox(frameColor, textColor, size,
+						   ImVec2(0, 0.5), ImVec2(padding.x, 0),
+						   "%llx  #%d", itemDataOffset, item.patternId);
+		}
+		else if(results.isVariableLen()) {
+			ImGui::TextBox(frameColor, textColor, size,
+						   ImVec2(0, 0.5), ImVec2(padding.x, 0),
+						   "%llx  (%d bytes)", itemDataOffset, item.len);
+		}
+		else {
+			ImGui::TextBox(frameColor, textColor, size,
+						   ImVec2(0, 0.5), ImVec2(padding.x, 0),
+						   "%llx", itemDataOffset);
+		}
 	}
 
-	// TODO: add pages
-	clipper.End();
-
-	ImGui::ItemSize(ImVec2(10, 30));
+	// drawn last to stay on top of the rows, applies next frame
+	ImGui::DoScrollbarVertical(&topRow, pageRowCount, count);
 
 	ImGui::EndChild();
 	ImGui::PopStyleVar(2); // ItemSpacing, WindowPadding
@@ -2,9 +2,17 @@
 #include "hexview.h"
 #include "search.h"
 
-void toolsDoInspectorWindow(const u8* fileBuffer, const i64 fileBufferSize, const SelectionState& selection);
+void toolsDoInspectorWindow(const struct FileSource& fileSource, const SelectionState& selection);
 void toolsDoTemplate(struct BrickWall* brickWall);
-void toolsDoOptions(i32* pColumnCount, i32 *pOutOffset);
+void toolsDoOptions(i32* pColumnCount, i64* pOutOffset);
 void toolsDoScript(struct Script* script, struct BrickWall* brickWall);
-bool toolsSearchParams(SearchParams* params);
-bool toolsSearchResults(const SearchParams& params, const ArrayTS<SearchResult>& results, u64* gotoOffset);
+bool toolsSearchParams(SearchParams* params, SearchOutput* output, const struct BrickWall& brickWall);
+// Ranges of the search scope, returns false for the whole file
+bool toolsSearchRanges(const SearchParams& params, const SelectionState& selection, const struct BrickWall& brickWall,
+                       Array<SearchRange>* ranges);
+void toolsSearchIndex(struct SearchIndex* index);
+// Occurrence counts and longest repeats of the file or the selection
+bool toolsSuffixArray(struct SearchSuffixArray* sfx, const struct FileSource& fileSource, const SelectionState& selection,
+                      const char* spillPath, i64* gotoOffset, i32* gotoLen);
+bool toolsSearchResults(const SearchParams& params, const SearchOutput& output, const SearchResultList& results,
+                        i64* gotoOffset, i32* gotoLen);
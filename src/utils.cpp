@@ -1,5 +1,14 @@
 #include "utils.h"
 
+// ftell/fseek are 32-bit on windows
+#ifdef _WIN32
+    #define ftell64 _ftelli64
+    #define fseek64 _fseeki64
+#else
+    #define ftell64 ftello
+    #define fseek64 fseeko
+#endif
+
 bool openFileReadAll(const char* path, GrowableBuffer* out_fb)
 {
     FILE* file = fopen(path, "rb");
@@ -8,10 +17,10 @@ bool openFileReadAll(const char* path, GrowableBuffer* out_fb)
         return false;
     }
 
-    i64 start = ftell(file);
-    fseek(file, 0, SEEK_END);
-    i64 len = ftell(file) - start;
-    fseek(file, start, SEEK_SET);
+    i64 start = ftell64(file);
+    fseek64(file, 0, SEEK_END);
+    i64 len = ftell64(file) - start;
+    fseek64(file, start, SEEK_SET);
 
 	char* buff = (char*)out_fb->append(nullptr, len + 1);
 
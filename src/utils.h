@@ -1,6 +1,7 @@
 #pragma once
 #include "base.h"
 #include <vector>
+#include <atomic>
 #include <intrin.h>
 
 // TODO: replace this with our own "lsk array"
@@ -113,66 +114,110 @@ struct MutexSpin
 	}
 };
 
-// Thread safe growable array
+/**
+ *  ArraySegmentedTS
+ *  - append only, one writer thread and any number of reader threads
+ *  - elements live in fixed size segments that never move, a push never copies prior elements
+ *  - the writer publishes count() after the element is written, readers only read below count()
+ *  - clear() and reserve() must not race with readers (the search is stopped first)
+ */
 template<typename T>
-struct ArrayTS
+struct ArraySegmentedTS
 {
-	MutexSpin mutexWrite;
-	T* bufferRead = nullptr;
-	T* buffer = nullptr;
-	i32 eltCount = 0;
-	i32 capacity;
+	enum: i64 {
+		SEGMENT_SHIFT = 16,
+		SEGMENT_SIZE = (i64)1 << SEGMENT_SHIFT,
+		SEGMENT_MASK = SEGMENT_SIZE - 1,
+		MAX_SEGMENTS = 1 << 17, // 8G elements
+	};
+
+	T** segments = nullptr;
+	i64 segmentCount = 0;
+	std::atomic<i64> eltCount{0};
+
+	~ArraySegmentedTS()
+	{
+		release();
+	}
 
-	~ArrayTS()
+	inline void release()
 	{
-		if(buffer) {
-			free(buffer);
+		for(i64 s = 0; s < segmentCount; s++) {
+			free(segments[s]);
 		}
+		free(segments);
+		segments = nullptr;
+		segmentCount = 0;
+		eltCount.store(0);
 	}
 
-	inline void reserve(i32 newCapacity)
+	inline void reserve(i64 newCapacity)
 	{
-		if(newCapacity < capacity) return;
-		bufferRead = buffer;
-
-		mutexWrite.lock();
-		capacity = newCapacity;
-		buffer = (T*)malloc(sizeof(T) * capacity);
-		memmove(buffer, bufferRead, sizeof(T) * eltCount);
-		T* bufferToFree = bufferRead;
-		bufferRead = buffer;
-		mutexWrite.unlock();
-
-		free(bufferToFree);
+		if(!segments) {
+			// the directory is allocated once so readers never see it move
+			segments = (T**)calloc(MAX_SEGMENTS, sizeof(T*));
+			assert_msg(segments, "Failed to allocate");
+		}
+
+		const i64 neededSegments = (newCapacity + SEGMENT_MASK) >> SEGMENT_SHIFT;
+		assert(neededSegments <= MAX_SEGMENTS);
+		while(segmentCount < neededSegments) {
+			segments[segmentCount] = (T*)malloc(sizeof(T) * SEGMENT_SIZE);
+			assert_msg(segments[segmentCount], "Failed to allocate");
+			segmentCount++;
+		}
 	}
 
 	inline T& push(T elt)
 	{
-		if(eltCount+1 > capacity)
-			reserve(capacity * 2);
-		return buffer[eltCount++] = elt;
+		const i64 index = eltCount.load(std::memory_order_relaxed);
+		if(index >= segmentCount * SEGMENT_SIZE) {
+			reserve(index + 1);
+		}
+
+		T& slot = segments[index >> SEGMENT_SHIFT][index & SEGMENT_MASK];
+		slot = elt;
+		eltCount.store(index + 1, std::memory_order_release);
+		return slot;
 	}
 
+	// Segments are kept for the next fill
 	inline void clear()
 	{
-		eltCount = 0;
+		eltCount.store(0);
+	}
+
+	// Both arrays must be idle (no reader, no writer)
+	inline void swap(ArraySegmentedTS& other)
+	{
+		T** otherSegments = other.segments;
+		other.segments = segments;
+		segments = otherSegments;
+
+		const i64 otherSegmentCount = other.segmentCount;
+		other.segmentCount = segmentCount;
+		segmentCount = otherSegmentCount;
+
+		const i64 otherCount = other.eltCount.load();
+		other.eltCount.store(eltCount.load());
+		eltCount.store(otherCount);
 	}
 
-	inline i32 count() const
+	inline i64 count() const
 	{
-		return eltCount;
+		return eltCount.load(std::memory_order_acquire);
 	}
 
-	inline T& operator[](i32 index)
+	inline T& operator[](i64 index)
 	{
-		assert(index < eltCount);
-		return bufferRead[index];
+		assert(index >= 0 && index < count());
+		return segments[index >> SEGMENT_SHIFT][index & SEGMENT_MASK];
 	}
 
-	inline const T& operator[](i32 index) const
+	inline const T& operator[](i64 index) const
 	{
-		assert(index < eltCount);
-		return bufferRead[index];
+		assert(index >= 0 && index < count());
+		return segments[index >> SEGMENT_SHIFT][index & SEGMENT_MASK];
 	}
 };
 
@@ -451,7 +496,7 @@ struct GrowableBufferT
 		release();
 	}
 
-	inline void init(i32 size_) {
+	inline void init(i64 size_) {
 		assert(data == nullptr);
 		data = (T*)malloc(size_);
 		assert_msg(data, "Failed to allocate");
@@ -459,7 +504,7 @@ struct GrowableBufferT
 		size = 0;
 	}
 
-	inline void reserve(i32 newCapacity) {
+	inline void reserve(i64 newCapacity) {
 		if(capacity < newCapacity) {
 			data = (T*)realloc(data, newCapacity);
 			assert_msg(data, "Failed to allocate");
@@ -480,7 +525,7 @@ struct GrowableBufferT
 		size = 0;
 	}
 
-	inline T* append(void* pData, i32 size_) {
+	inline T* append(void* pData, i64 size_) {
 		if(size + size_ > capacity) {
 			reserve(MAX(capacity * 2, size + size_));
 		}